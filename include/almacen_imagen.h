@@ -0,0 +1,179 @@
+#ifndef ALMACEN_IMAGEN_H
+#define ALMACEN_IMAGEN_H
+
+#include "cliente.h"
+#include "imagen_clientes.h"
+#include <algorithm>
+#include <cctype>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace ERP {
+    
+    // Clientes servidos directamente desde una imagen mapeada (imagen_clientes.h), de solo
+    // lectura: arranca sin cargar nada y las vistas apuntan a las páginas del archivo, que el
+    // kernel comparte entre todos los procesos del host que mapean la misma imagen.
+    //  - id: búsqueda binaria sobre los registros; (razon_social, id) y ruc: índices de la imagen.
+    //  - Las escrituras se rechazan: la imagen se regenera con generar() desde otro almacén.
+    //  - Es una foto a la fecha de generada(): no ve los cambios posteriores de la base, por
+    //    eso main.cpp rechaza al arrancar las imágenes más viejas que ERP_IMAGEN_MAX_EDAD_S.
+    //  - La imagen no guarda fecha_actualizacion, así que el filtro updated_after falla.
+    class AlmacenImagen : public AlmacenClientes {
+    private:
+        std::shared_ptr<const ImagenClientes> imagen;
+        
+    public:
+        explicit AlmacenImagen(std::shared_ptr<const ImagenClientes> imagen_) : imagen(std::move(imagen_)) {}
+        
+        // Volcar todos los clientes de 'origen' (activos o no) a una imagen en 'ruta'
+        static bool generar(AlmacenClientes& origen, const std::string& ruta) {
+            EscritorImagen escritor;
+            FiltroClientes todos;
+            todos.activo = FiltroClientes::Activo::Todos;
+            bool ok = origen.recorrer_vistas(0, nullptr, [&](const VistaCliente& fila) {
+                escritor.agregar(fila.id(), fila.version(), fila.activo(),
+                                 {fila.codigo(), fila.razon_social(), fila.ruc(), fila.direccion(), fila.telefono(), fila.email()});
+                return true;
+            }, nullptr, "", CAMPOS_TODOS, &todos);
+            return ok && escritor.escribir(ruta);
+        }
+        
+        bool crear(const Cliente& cliente) override {
+            return false;
+        }
+        
+        Cliente obtener_por_id(int id, const std::string& token = "") override {
+            const RegistroImagen* r = imagen->buscar_id(id);
+            return r ? VistaCliente(imagen, *r).materializar() : Cliente();
+        }
+        
+        // Sin locks ni copias: la imagen es inmutable y cada vista la mantiene mapeada
+        bool recorrer_vistas(int limite, const CursorCliente* despues,
+                             const std::function<bool(const VistaCliente&)>& por_fila,
+                             std::string* siguiente = nullptr, const std::string& token = "",
+                             unsigned campos = CAMPOS_TODOS, const FiltroClientes* filtro = nullptr) override {
+            FiltroClientes por_defecto;
+            const FiltroClientes& f = filtro ? *filtro : por_defecto;
+            if (!f.actualizado_despues.empty()) return false;
+            
+            const RegistroImagen* ultimo = nullptr;
+            int entregados = 0;
+            bool hay_mas = false;
+            auto visitar = [&](const RegistroImagen* r) {
+                if (!r || !cumple(*r, f, despues)) return true;
+                if (limite > 0 && entregados == limite) {
+                    hay_mas = true;
+                    return false;
+                }
+                if (!por_fila(VistaCliente(imagen, *r))) return false;
+                ultimo = r;
+                entregados++;
+                return true;
+            };
+            
+            bool completo = true;
+            if (!f.ruc.empty()) {
+                for (size_t i = imagen->primero_con_ruc(f.ruc); i < imagen->cantidad() && completo; i++) {
+                    const RegistroImagen* r = imagen->en_orden_ruc(i);
+                    if (r && imagen->texto(*r, 2) != f.ruc) break;
+                    completo = visitar(r);
+                }
+            } else {
+                size_t i = despues ? imagen->posterior_a(despues->razon_social, despues->id) : 0;
+                for (; i < imagen->cantidad() && completo; i++) completo = visitar(imagen->en_orden(i));
+            }
+            if (!completo && !hay_mas) return false; // Lo cortó por_fila
+            
+            if (siguiente && hay_mas && ultimo) {
+                CursorCliente cursor;
+                cursor.razon_social = std::string(imagen->texto(*ultimo, 1));
+                cursor.id = ultimo->id;
+                *siguiente = cursor.codificar();
+            }
+            return true;
+        }
+        
+        // Coincidencia parcial sin distinguir mayúsculas, como en AlmacenMemoria
+        std::vector<Cliente> buscar(const std::string& texto, int limite) override {
+            std::string patron = texto;
+            for (char& c : patron) c = (char)std::tolower((unsigned char)c);
+            std::vector<Cliente> clientes;
+            for (size_t i = 0; i < imagen->cantidad() && (int)clientes.size() < limite; i++) {
+                const RegistroImagen* r = imagen->en_orden(i);
+                if (!r || !r->activo) continue;
+                if (contiene(imagen->texto(*r, 1), patron) || contiene(imagen->texto(*r, 0), patron) ||
+                    contiene(imagen->texto(*r, 2), patron)) {
+                    clientes.push_back(VistaCliente(imagen, *r).materializar());
+                }
+            }
+            return clientes;
+        }
+        
+        ResultadoActualizacion actualizar(Cliente& cliente) override {
+            return ResultadoActualizacion::Error;
+        }
+        
+        ResultadoSincronizacion sincronizar(const std::vector<Cliente>& clientes, size_t tamano_lote = 1000) override {
+            ResultadoSincronizacion resultado;
+            if (tamano_lote == 0) tamano_lote = 1000;
+            resultado.lotes_fallidos = (int)((clientes.size() + tamano_lote - 1) / tamano_lote);
+            return resultado;
+        }
+        
+        bool eliminar(int id) override {
+            return false;
+        }
+        
+        // Mismo CSV que COPY sobre SQL_EXPORTAR; los registros ya están por id
+        bool exportar_csv(const std::function<bool(const char*, size_t)>& consumidor) override {
+            const size_t tam_bloque = 64 * 1024;
+            std::string bloque = "id,codigo,razon_social,ruc,direccion,telefono,email,activo\n";
+            for (size_t i = 0; i < imagen->cantidad(); i++) {
+                const RegistroImagen& r = imagen->registro(i);
+                if (!r.activo) continue;
+                bloque += std::to_string(r.id);
+                for (size_t k = 0; k < 6; k++) {
+                    bloque += ',';
+                    agregar_csv(bloque, imagen->texto(r, k));
+                }
+                bloque += ",t\n";
+                if (bloque.size() >= tam_bloque) {
+                    if (!consumidor(bloque.data(), bloque.size())) return false;
+                    bloque.clear();
+                }
+            }
+            return bloque.empty() || consumidor(bloque.data(), bloque.size());
+        }
+        
+        // El conteo de activos viene en la cabecera
+        long long estimar_activos() override {
+            return imagen->activos();
+        }
+        
+        long long contar_activos() override {
+            return imagen->activos();
+        }
+        
+    private:
+        bool cumple(const RegistroImagen& r, const FiltroClientes& f, const CursorCliente* despues) const {
+            if (f.activo != FiltroClientes::Activo::Todos && (r.activo != 0) != (f.activo == FiltroClientes::Activo::Si)) return false;
+            if (!f.codigo_prefijo.empty() && imagen->texto(r, 0).substr(0, f.codigo_prefijo.size()) != f.codigo_prefijo) return false;
+            if (!despues || f.ruc.empty()) return true; // Sin ruc el recorrido ya empieza después del cursor
+            int comparacion = imagen->texto(r, 1).compare(despues->razon_social);
+            return comparacion > 0 || (comparacion == 0 && r.id > despues->id);
+        }
+        
+        // ¿'texto' contiene 'patron' (ya en minúsculas) sin distinguir mayúsculas?
+        static bool contiene(std::string_view texto, const std::string& patron) {
+            auto it = std::search(texto.begin(), texto.end(), patron.begin(), patron.end(), [](char a, char b) {
+                return std::tolower((unsigned char)a) == (unsigned char)b;
+            });
+            return it != texto.end() || patron.empty();
+        }
+    };
+    
+} // namespace ERP
+
+#endif
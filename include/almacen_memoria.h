@@ -0,0 +1,590 @@
+#ifndef ALMACEN_MEMORIA_H
+#define ALMACEN_MEMORIA_H
+
+#include "cliente.h"
+#include "bitacora.h"
+#include <algorithm>
+#include <cctype>
+#include <ctime>
+#include <deque>
+#include <memory>
+#include <set>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace ERP {
+    
+    // Clientes en memoria, sin PostgreSQL. Cada registro es un Cliente inmutable compartido:
+    // una escritura publica uno nuevo, así las vistas que ya se entregaron siguen siendo
+    // válidas y los recorridos no retienen el lock mientras el controller escribe al socket.
+    //  - id, codigo y ruc: índices hash (O(1)); codigo y ruc son únicos como en la tabla.
+    //  - (razon_social, id): índice ordenado para listar y paginar por cursor.
+    //  - Lecturas concurrentes con shared_mutex; las escrituras son exclusivas.
+    // El orden de razon_social es por bytes, no por la collation de la base.
+    // Con usar_bitacora() es write-ahead: una escritura se valida y se anota en la bitácora bajo
+    // el lock, pero queda "preparada" (invisible para las lecturas) hasta su fsync, y recién
+    // entonces se publica, en orden de secuencia. Las validaciones de las escrituras siguientes
+    // ya cuentan lo preparado. Si la bitácora falla, lo no durable se descarta y el almacén
+    // pasa a solo lectura: aplicar en memoria algo que un reinicio perdería sería peor.
+    class AlmacenMemoria : public AlmacenClientes {
+    private:
+        struct Registro {
+            std::shared_ptr<const Cliente> cliente;
+            std::string actualizado; // "AAAA-MM-DD HH:MM:SS", hora local como CURRENT_TIMESTAMP
+        };
+        
+        using Clave = std::pair<std::string, int>; // (razon_social, id)
+        
+        mutable std::shared_mutex mtx;
+        std::unordered_map<int, Registro> por_id;
+        std::unordered_map<std::string, int> por_codigo;
+        std::unordered_map<std::string, int> por_ruc;
+        std::set<Clave> orden;
+        int proximo_id = 1;
+        long long activos = 0;
+        
+        Bitacora* bitacora = nullptr;
+        std::mutex mtx_compactacion;
+        
+        // Escrituras anotadas que esperan su fsync para publicarse, en orden de secuencia (la
+        // del último registro de cada una). Los mapas siguientes son la última imagen preparada
+        // de cada id y quién reservó cada codigo/ruc, para validar contra lo que ya viene.
+        struct Preparada {
+            uint64_t secuencia = 0;
+            std::vector<Registro> registros;
+        };
+        struct ImagenPreparada {
+            uint64_t secuencia;
+            Registro registro;
+        };
+        std::deque<Preparada> preparadas;
+        std::unordered_map<int, ImagenPreparada> preparado_por_id;
+        std::unordered_map<std::string, int> codigo_preparado;
+        std::unordered_map<std::string, int> ruc_preparado;
+        bool solo_lectura = false; // La bitácora falló
+        
+        static constexpr char REGISTRO_CLIENTE = 1; // Tipo de registro de la bitácora
+        
+    public:
+        AlmacenMemoria() = default;
+        
+        AlmacenMemoria(const AlmacenMemoria&) = delete;
+        AlmacenMemoria& operator=(const AlmacenMemoria&) = delete;
+        
+        // Modo durable: recuperar el estado de la instantánea y la bitácora, y desde ahí anotar
+        // cada escritura. Cada registro es la imagen completa del cliente tras el cambio, así
+        // reaplicarlo es idempotente. Llamar antes de atender peticiones; la bitácora debe
+        // destruirse antes que el almacén.
+        bool usar_bitacora(Bitacora& b) {
+            std::unique_lock<std::shared_mutex> lock(mtx);
+            size_t invalidos = 0;
+            bool ok = b.recuperar([&](const char* datos, size_t largo) {
+                Registro r;
+                if (decodificar(datos, largo, r)) restaurar(r);
+                else invalidos++;
+            });
+            if (!ok) return false;
+            if (invalidos) std::cerr << "Bitacora: " << invalidos << " registros de tipo desconocido" << std::endl;
+            bitacora = &b;
+            b.al_superar_umbral([this] { compactar(); });
+            return true;
+        }
+        
+        // Escribir una instantánea del estado y descartar la bitácora que cubre. Los lectores
+        // siguen mientras se copia el estado; las escrituras esperan a que termine la copia.
+        // Incluye lo preparado: está en el .wal que se descarta, y rotar() lo hace durable.
+        bool compactar() {
+            std::lock_guard<std::mutex> una_a_la_vez(mtx_compactacion);
+            if (!bitacora) return false;
+            std::string registros;
+            uint64_t generacion;
+            {
+                std::shared_lock<std::shared_mutex> lock(mtx);
+                if (solo_lectura) return false;
+                for (const auto& par : por_id) {
+                    if (!preparado_por_id.count(par.first)) Bitacora::enmarcar(registros, codificar(par.second));
+                }
+                for (const auto& par : preparado_por_id) Bitacora::enmarcar(registros, codificar(par.second.registro));
+                generacion = bitacora->rotar();
+            }
+            if (!bitacora->sana()) return false;
+            return bitacora->escribir_instantanea(registros, generacion);
+        }
+        
+        bool crear(const Cliente& cliente) override {
+            uint64_t secuencia;
+            {
+                std::unique_lock<std::shared_mutex> lock(mtx);
+                if (solo_lectura) return false;
+                Preparada escritura;
+                if (!insertar(cliente, escritura)) return false;
+                secuencia = encolar(std::move(escritura));
+            }
+            return confirmar(secuencia);
+        }
+        
+        Cliente obtener_por_id(int id, const std::string& token = "") override {
+            std::shared_lock<std::shared_mutex> lock(mtx);
+            auto it = por_id.find(id);
+            if (it == por_id.end()) return Cliente();
+            return *it->second.cliente;
+        }
+        
+        // Toma bajo lock compartido solo los punteros de las filas que cumplen el filtro y las
+        // entrega después, ya sin lock. Con filtro por ruc se resuelve por el índice hash.
+        bool recorrer_vistas(int limite, const CursorCliente* despues,
+                             const std::function<bool(const VistaCliente&)>& por_fila,
+                             std::string* siguiente = nullptr, const std::string& token = "",
+                             unsigned campos = CAMPOS_TODOS, const FiltroClientes* filtro = nullptr) override {
+            FiltroClientes por_defecto;
+            const FiltroClientes& f = filtro ? *filtro : por_defecto;
+            std::string desde = normalizar_fecha(f.actualizado_despues);
+            size_t maximo = limite > 0 ? (size_t)limite + 1 : (size_t)-1;
+            
+            std::vector<std::shared_ptr<const Cliente>> filas;
+            {
+                std::shared_lock<std::shared_mutex> lock(mtx);
+                auto cumple = [&](const Registro& r) {
+                    const Cliente& c = *r.cliente;
+                    if (f.activo != FiltroClientes::Activo::Todos && c.activo != (f.activo == FiltroClientes::Activo::Si)) return false;
+                    if (!f.ruc.empty() && c.ruc != f.ruc) return false;
+                    if (!f.codigo_prefijo.empty() && c.codigo.compare(0, f.codigo_prefijo.size(), f.codigo_prefijo) != 0) return false;
+                    if (!desde.empty() && !(r.actualizado > desde)) return false;
+                    return !despues || Clave(c.razon_social, c.id) > Clave(despues->razon_social, despues->id);
+                };
+                
+                if (!f.ruc.empty()) {
+                    auto it = por_ruc.find(f.ruc);
+                    if (it != por_ruc.end() && cumple(por_id.at(it->second))) {
+                        filas.push_back(por_id.at(it->second).cliente);
+                    }
+                } else {
+                    auto it = despues ? orden.upper_bound(Clave(despues->razon_social, despues->id)) : orden.begin();
+                    for (; it != orden.end() && filas.size() < maximo; ++it) {
+                        const Registro& r = por_id.at(it->second);
+                        if (cumple(r)) filas.push_back(r.cliente);
+                    }
+                }
+            }
+            
+            size_t entregar = std::min(filas.size(), limite > 0 ? (size_t)limite : filas.size());
+            for (size_t i = 0; i < entregar; i++) {
+                if (!por_fila(VistaCliente(filas[i]))) return false;
+            }
+            if (siguiente && limite > 0 && filas.size() > entregar) {
+                CursorCliente cursor;
+                cursor.razon_social = filas[entregar - 1]->razon_social;
+                cursor.id = filas[entregar - 1]->id;
+                *siguiente = cursor.codificar();
+            }
+            return true;
+        }
+        
+        // Coincidencia parcial sin distinguir mayúsculas en razón social, código o RUC, en orden
+        // de razón social (no hay similitud trigram: es un recorrido completo)
+        std::vector<Cliente> buscar(const std::string& texto, int limite) override {
+            std::string patron = minusculas(texto);
+            std::vector<Cliente> clientes;
+            std::shared_lock<std::shared_mutex> lock(mtx);
+            for (auto it = orden.begin(); it != orden.end() && (int)clientes.size() < limite; ++it) {
+                const Cliente& c = *por_id.at(it->second).cliente;
+                if (!c.activo) continue;
+                if (minusculas(c.razon_social).find(patron) != std::string::npos ||
+                    minusculas(c.codigo).find(patron) != std::string::npos ||
+                    minusculas(c.ruc).find(patron) != std::string::npos) {
+                    clientes.push_back(c);
+                }
+            }
+            return clientes;
+        }
+        
+        ResultadoActualizacion actualizar(Cliente& cliente) override {
+            uint64_t secuencia;
+            int version_nueva;
+            {
+                std::unique_lock<std::shared_mutex> lock(mtx);
+                if (solo_lectura) return ResultadoActualizacion::Error;
+                const Cliente* actual = vigente(cliente.id);
+                if (!actual || !actual->activo) return ResultadoActualizacion::NoEncontrado;
+                if (actual->version != cliente.version) {
+                    cliente.version = actual->version;
+                    return ResultadoActualizacion::Conflicto;
+                }
+                if (ocupado_codigo(cliente.codigo, cliente.id) || ocupado_ruc(cliente.ruc, cliente.id)) {
+                    return ResultadoActualizacion::Error;
+                }
+                
+                auto nuevo = std::make_shared<Cliente>(cliente);
+                nuevo->activo = actual->activo;
+                nuevo->version = actual->version + 1;
+                version_nueva = nuevo->version;
+                Preparada escritura;
+                preparar(Registro{nuevo, ahora()}, escritura);
+                secuencia = encolar(std::move(escritura));
+            }
+            if (!confirmar(secuencia)) return ResultadoActualizacion::Error;
+            cliente.version = version_nueva;
+            return ResultadoActualizacion::Actualizado;
+        }
+        
+        // Upsert por código como SQL_SINCRONIZAR (reactiva los dados de baja), con un lock
+        // exclusivo por lote. Un lote con un RUC ya usado por otro código se rechaza completo,
+        // sin aplicar ninguna fila. Con bitácora, el lote se confirma con un solo fsync.
+        ResultadoSincronizacion sincronizar(const std::vector<Cliente>& clientes, size_t tamano_lote = 1000) override {
+            ResultadoSincronizacion resultado;
+            if (tamano_lote == 0) tamano_lote = 1000;
+            for (size_t inicio = 0; inicio < clientes.size(); inicio += tamano_lote) {
+                size_t fin = std::min(inicio + tamano_lote, clientes.size());
+                std::unique_lock<std::shared_mutex> lock(mtx);
+                if (solo_lectura) {
+                    resultado.lotes_fallidos++;
+                    continue;
+                }
+                ResultadoSincronizacion lote;
+                Preparada escritura;
+                
+                bool valido = true;
+                std::unordered_map<std::string, std::string> ruc_de_lote; // ruc -> código en el lote
+                for (size_t i = inicio; i < fin && valido; i++) {
+                    const Cliente& c = clientes[i];
+                    auto previo = ruc_de_lote.emplace(c.ruc, c.codigo);
+                    valido = !ocupado_ruc(c.ruc, dueno_codigo(c.codigo)) && (previo.second || previo.first->second == c.codigo);
+                }
+                if (!valido) {
+                    resultado.lotes_fallidos++;
+                    continue;
+                }
+                
+                for (size_t i = inicio; i < fin; i++) {
+                    const Cliente& c = clientes[i];
+                    int existente = dueno_codigo(c.codigo);
+                    if (existente == 0) {
+                        insertar(c, escritura);
+                        lote.insertados++;
+                        continue;
+                    }
+                    const Cliente& actual = *vigente(existente);
+                    if (actual.razon_social == c.razon_social && actual.ruc == c.ruc && actual.direccion == c.direccion &&
+                        actual.telefono == c.telefono && actual.email == c.email && actual.activo) {
+                        lote.sin_cambios++;
+                        continue;
+                    }
+                    auto nuevo = std::make_shared<Cliente>(actual);
+                    nuevo->razon_social = c.razon_social;
+                    nuevo->ruc = c.ruc;
+                    nuevo->direccion = c.direccion;
+                    nuevo->telefono = c.telefono;
+                    nuevo->email = c.email;
+                    nuevo->activo = true;
+                    nuevo->version = actual.version + 1;
+                    preparar(Registro{nuevo, ahora()}, escritura);
+                    lote.actualizados++;
+                }
+                
+                uint64_t secuencia = encolar(std::move(escritura));
+                lock.unlock();
+                if (!confirmar(secuencia)) {
+                    resultado.lotes_fallidos++;
+                    continue;
+                }
+                resultado.insertados += lote.insertados;
+                resultado.actualizados += lote.actualizados;
+                resultado.sin_cambios += lote.sin_cambios;
+            }
+            return resultado;
+        }
+        
+        // Eliminación lógica, como en la tabla
+        bool eliminar(int id) override {
+            uint64_t secuencia;
+            {
+                std::unique_lock<std::shared_mutex> lock(mtx);
+                if (solo_lectura) return false;
+                const Cliente* actual = vigente(id);
+                if (!actual) return true; // El UPDATE sin filas tampoco falla
+                auto nuevo = std::make_shared<Cliente>(*actual);
+                nuevo->activo = false;
+                nuevo->version++;
+                Preparada escritura;
+                preparar(Registro{nuevo, ahora()}, escritura);
+                secuencia = encolar(std::move(escritura));
+            }
+            return confirmar(secuencia);
+        }
+        
+        // Mismo CSV que COPY ... (FORMAT csv, HEADER true) sobre SQL_EXPORTAR
+        bool exportar_csv(const std::function<bool(const char*, size_t)>& consumidor) override {
+            std::vector<std::shared_ptr<const Cliente>> filas;
+            {
+                std::shared_lock<std::shared_mutex> lock(mtx);
+                filas.reserve(por_id.size());
+                for (const auto& par : por_id) {
+                    if (par.second.cliente->activo) filas.push_back(par.second.cliente);
+                }
+            }
+            std::sort(filas.begin(), filas.end(), [](const auto& a, const auto& b) { return a->id < b->id; });
+            
+            const size_t tam_bloque = 64 * 1024;
+            std::string bloque = "id,codigo,razon_social,ruc,direccion,telefono,email,activo\n";
+            for (const auto& c : filas) {
+                bloque += std::to_string(c->id);
+                for (const std::string* valor : {&c->codigo, &c->razon_social, &c->ruc, &c->direccion, &c->telefono, &c->email}) {
+                    bloque += ',';
+                    agregar_csv(bloque, *valor);
+                }
+                bloque += c->activo ? ",t\n" : ",f\n";
+                if (bloque.size() >= tam_bloque) {
+                    if (!consumidor(bloque.data(), bloque.size())) return false;
+                    bloque.clear();
+                }
+            }
+            return bloque.empty() || consumidor(bloque.data(), bloque.size());
+        }
+        
+        // Exactos y baratos: la estimación es el mismo contador
+        long long estimar_activos() override {
+            return contar_activos();
+        }
+        
+        long long contar_activos() override {
+            std::shared_lock<std::shared_mutex> lock(mtx);
+            return activos;
+        }
+        
+    private:
+        // Requiere el lock exclusivo. false si el código o el RUC ya existen (o están reservados
+        // por una escritura preparada).
+        bool insertar(const Cliente& cliente, Preparada& escritura) {
+            if (dueno_codigo(cliente.codigo) || dueno_ruc(cliente.ruc)) return false;
+            auto nuevo = std::make_shared<Cliente>(cliente);
+            nuevo->id = proximo_id++;
+            nuevo->version = 1;
+            preparar(Registro{nuevo, ahora()}, escritura);
+            return true;
+        }
+        
+        // Requiere el lock exclusivo. Sin bitácora publica el registro en el acto; con ella lo
+        // anota y lo deja preparado, visible solo para las validaciones de otras escrituras.
+        void preparar(const Registro& r, Preparada& escritura) {
+            if (!bitacora) {
+                publicar(r);
+                return;
+            }
+            const Cliente& c = *r.cliente;
+            escritura.secuencia = bitacora->agregar(codificar(r));
+            escritura.registros.push_back(r);
+            preparado_por_id[c.id] = ImagenPreparada{escritura.secuencia, r};
+            codigo_preparado[c.codigo] = c.id;
+            ruc_preparado[c.ruc] = c.id;
+        }
+        
+        // Requiere el lock exclusivo. Devuelve la secuencia a confirmar (0: nada que esperar).
+        uint64_t encolar(Preparada&& escritura) {
+            if (escritura.registros.empty()) return 0;
+            uint64_t secuencia = escritura.secuencia;
+            preparadas.push_back(std::move(escritura));
+            return secuencia;
+        }
+        
+        // Llamar sin el lock: espera el fsync del grupo que contiene la escritura y publica todo
+        // lo que ya es durable. Si la bitácora falló, descarta lo demás y deja de aceptar escrituras.
+        bool confirmar(uint64_t secuencia) {
+            if (secuencia == 0) return true;
+            bool ok = bitacora->esperar(secuencia);
+            std::unique_lock<std::shared_mutex> lock(mtx);
+            publicar_durables();
+            if (!ok && !solo_lectura) {
+                std::cerr << "Bitacora fallida: se descartan " << preparadas.size()
+                          << " escrituras no durables y el almacen pasa a solo lectura" << std::endl;
+                solo_lectura = true;
+                preparadas.clear();
+                preparado_por_id.clear();
+                codigo_preparado.clear();
+                ruc_preparado.clear();
+            }
+            return ok;
+        }
+        
+        // Requiere el lock exclusivo. Publica en orden las preparadas que ya están en disco.
+        void publicar_durables() {
+            uint64_t durable = bitacora->durable_hasta();
+            while (!preparadas.empty() && preparadas.front().secuencia <= durable) {
+                const Preparada& escritura = preparadas.front();
+                for (const Registro& r : escritura.registros) {
+                    publicar(r);
+                    const Cliente& c = *r.cliente;
+                    auto it = preparado_por_id.find(c.id);
+                    if (it != preparado_por_id.end() && it->second.secuencia <= escritura.secuencia) preparado_por_id.erase(it);
+                    liberar_reserva(codigo_preparado, c.codigo, c.id);
+                    liberar_reserva(ruc_preparado, c.ruc, c.id);
+                }
+                preparadas.pop_front();
+            }
+        }
+        
+        // Ya publicado, el índice publicado responde por 'valor'
+        static void liberar_reserva(std::unordered_map<std::string, int>& reservas, const std::string& valor, int id) {
+            auto it = reservas.find(valor);
+            if (it != reservas.end() && it->second == id) reservas.erase(it);
+        }
+        
+        // Requiere el lock. La última imagen de 'id' contando lo preparado; nullptr si no existe.
+        const Cliente* vigente(int id) const {
+            auto preparado = preparado_por_id.find(id);
+            if (preparado != preparado_por_id.end()) return preparado->second.registro.cliente.get();
+            auto it = por_id.find(id);
+            return it == por_id.end() ? nullptr : it->second.cliente.get();
+        }
+        
+        // Requiere el lock. Id del cliente cuya imagen vigente tiene 'valor' en 'campo'; 0 si
+        // ninguno. Un índice puede apuntar a un cliente cuyo cambio preparado ya soltó el valor.
+        int dueno(const std::unordered_map<std::string, int>& publicado, const std::unordered_map<std::string, int>& reservado,
+                  const std::string& valor, std::string Cliente::*campo) const {
+            for (const auto* indice : {&reservado, &publicado}) {
+                auto it = indice->find(valor);
+                if (it == indice->end()) continue;
+                const Cliente* c = vigente(it->second);
+                if (c && c->*campo == valor) return it->second;
+            }
+            return 0;
+        }
+        
+        int dueno_codigo(const std::string& codigo) const {
+            return dueno(por_codigo, codigo_preparado, codigo, &Cliente::codigo);
+        }
+        
+        int dueno_ruc(const std::string& ruc) const {
+            return dueno(por_ruc, ruc_preparado, ruc, &Cliente::ruc);
+        }
+        
+        // ¿El valor pertenece a un cliente distinto de 'id'?
+        bool ocupado_codigo(const std::string& codigo, int id) const {
+            int d = dueno_codigo(codigo);
+            return d != 0 && d != id;
+        }
+        
+        bool ocupado_ruc(const std::string& ruc, int id) const {
+            int d = dueno_ruc(ruc);
+            return d != 0 && d != id;
+        }
+        
+        // Requiere el lock exclusivo. Instala la imagen (upsert por id) en los índices publicados.
+        void publicar(const Registro& r) {
+            auto it = por_id.find(r.cliente->id);
+            Registro& destino = it == por_id.end() ? indexar_nuevo(r.cliente) : it->second;
+            if (it != por_id.end()) reindexar(destino, r.cliente);
+            destino.actualizado = r.actualizado;
+        }
+        
+        Registro& indexar_nuevo(const std::shared_ptr<const Cliente>& nuevo) {
+            por_codigo[nuevo->codigo] = nuevo->id;
+            por_ruc[nuevo->ruc] = nuevo->id;
+            orden.insert(Clave(nuevo->razon_social, nuevo->id));
+            if (nuevo->activo) activos++;
+            Registro& r = por_id[nuevo->id];
+            r.cliente = nuevo;
+            return r;
+        }
+        
+        // Ajustar los índices de las claves que cambiaron
+        void reindexar(Registro& r, const std::shared_ptr<const Cliente>& nuevo) {
+            const Cliente& viejo = *r.cliente;
+            if (viejo.codigo != nuevo->codigo) {
+                por_codigo.erase(viejo.codigo);
+                por_codigo[nuevo->codigo] = nuevo->id;
+            }
+            if (viejo.ruc != nuevo->ruc) {
+                por_ruc.erase(viejo.ruc);
+                por_ruc[nuevo->ruc] = nuevo->id;
+            }
+            if (viejo.razon_social != nuevo->razon_social) {
+                orden.erase(Clave(viejo.razon_social, viejo.id));
+                orden.insert(Clave(nuevo->razon_social, nuevo->id));
+            }
+            activos += (long long)nuevo->activo - (long long)viejo.activo;
+            r.cliente = nuevo;
+        }
+        
+        // Reaplicar un registro recuperado de la bitácora
+        void restaurar(const Registro& recuperado) {
+            publicar(recuperado);
+            proximo_id = std::max(proximo_id, recuperado.cliente->id + 1);
+        }
+        
+        // [tipo][id i32][version i32][activo u8] y codigo, razon_social, ruc, direccion,
+        // telefono, email y actualizado como [largo u32][bytes], en el orden del host
+        static std::string codificar(const Registro& r) {
+            const Cliente& c = *r.cliente;
+            std::string datos;
+            datos.reserve(64 + c.codigo.size() + c.razon_social.size() + c.direccion.size());
+            int32_t enteros[2] = {c.id, c.version};
+            datos += REGISTRO_CLIENTE;
+            datos.append((const char*)enteros, sizeof(enteros));
+            datos += c.activo ? '\1' : '\0';
+            for (const std::string* texto : {&c.codigo, &c.razon_social, &c.ruc, &c.direccion, &c.telefono, &c.email, &r.actualizado}) {
+                uint32_t largo = (uint32_t)texto->size();
+                datos.append((const char*)&largo, sizeof(largo));
+                datos += *texto;
+            }
+            return datos;
+        }
+        
+        static bool decodificar(const char* datos, size_t largo, Registro& r) {
+            const size_t fijo = 1 + 2 * sizeof(int32_t) + 1;
+            if (largo < fijo || datos[0] != REGISTRO_CLIENTE) return false;
+            auto c = std::make_shared<Cliente>();
+            int32_t entero;
+            std::memcpy(&entero, datos + 1, sizeof(entero));
+            c->id = entero;
+            std::memcpy(&entero, datos + 1 + sizeof(int32_t), sizeof(entero));
+            c->version = entero;
+            c->activo = datos[fijo - 1] != 0;
+            
+            size_t pos = fijo;
+            for (std::string* texto : {&c->codigo, &c->razon_social, &c->ruc, &c->direccion, &c->telefono, &c->email, &r.actualizado}) {
+                uint32_t n;
+                if (largo - pos < sizeof(n)) return false;
+                std::memcpy(&n, datos + pos, sizeof(n));
+                pos += sizeof(n);
+                if (largo - pos < n) return false;
+                texto->assign(datos + pos, n);
+                pos += n;
+            }
+            r.cliente = c;
+            return true;
+        }
+        
+        static std::string ahora() {
+            std::time_t t = std::time(nullptr);
+            std::tm local{};
+            #ifdef _WIN32
+                localtime_s(&local, &t);
+            #else
+                localtime_r(&t, &local);
+            #endif
+            char texto[32];
+            std::strftime(texto, sizeof(texto), "%Y-%m-%d %H:%M:%S", &local);
+            return texto;
+        }
+        
+        // "AAAA-MM-DDTHH:MM" -> "AAAA-MM-DD HH:MM:00" para compararla como texto con 'actualizado'
+        static std::string normalizar_fecha(std::string fecha) {
+            if (fecha.empty()) return fecha;
+            if (fecha.size() == 10) return fecha + " 00:00:00";
+            fecha[10] = ' ';
+            if (fecha.size() == 16) fecha += ":00";
+            return fecha;
+        }
+        
+        static std::string minusculas(std::string texto) {
+            for (char& c : texto) c = (char)std::tolower((unsigned char)c);
+            return texto;
+        }
+    };
+    
+} // namespace ERP
+
+#endif
@@ -0,0 +1,261 @@
+#ifndef ASYNC_DATABASE_H
+#define ASYNC_DATABASE_H
+
+#include <libpq-fe.h>
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <deque>
+#include <functional>
+#include <stdexcept>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#else
+#include <sys/select.h>
+#endif
+
+namespace ERP {
+    
+    // Conexiones libpq no bloqueantes pensadas para integrarse al select() del servidor.
+    // Cada conexión atiende una query a la vez; el resto espera en cola, así un solo hilo
+    // mantiene tantas queries en vuelo como conexiones tenga el pool. Una conexión caída se
+    // reconecta con PQresetStart/PQresetPoll desde el mismo bucle, con backoff exponencial;
+    // mientras no quede ninguna sana, las queries fallan en el acto en vez de esperar en cola.
+    class AsyncDatabase {
+    public:
+        // Recibe el resultado (nullptr si hubo error); se libera al volver del callback
+        using Callback = std::function<void(PGresult*)>;
+    
+    private:
+        using Reloj = std::chrono::steady_clock;
+        
+        static constexpr std::chrono::seconds PLAZO_RECONEXION{5};
+        static constexpr std::chrono::milliseconds ESPERA_INICIAL{100};
+        static constexpr std::chrono::milliseconds ESPERA_MAXIMA{30000};
+        
+        struct Pendiente {
+            std::string query;
+            std::vector<std::string> params;
+            Callback callback;
+        };
+        
+        struct Conexion {
+            PGconn* conn = nullptr;
+            bool ocupada = false;
+            bool pendiente_flush = false;
+            PGresult* resultado = nullptr;
+            Callback callback;
+            
+            bool reconectando = false;
+            PostgresPollingStatusType sondeo = PGRES_POLLING_WRITING;
+            Reloj::time_point limite_reconexion;
+            Reloj::time_point proximo_intento;
+            std::chrono::milliseconds espera = ESPERA_INICIAL;
+        };
+        
+        std::vector<Conexion> conexiones;
+        std::deque<Pendiente> cola;
+        
+        bool iniciar(Conexion& c, Pendiente& p) {
+            std::vector<const char*> valores;
+            valores.reserve(p.params.size());
+            for (const auto& v : p.params) valores.push_back(v.c_str());
+            
+            if (!PQsendQueryParams(c.conn, p.query.c_str(), (int)valores.size(),
+                                   nullptr, valores.data(), nullptr, nullptr, 0)) {
+                std::cerr << "Error enviando query async: " << PQerrorMessage(c.conn) << std::endl;
+                return false;
+            }
+            c.ocupada = true;
+            c.callback = std::move(p.callback);
+            c.pendiente_flush = PQflush(c.conn) == 1;
+            return true;
+        }
+        
+        static bool sana(const Conexion& c) {
+            return !c.reconectando && PQstatus(c.conn) == CONNECTION_OK;
+        }
+        
+        void despachar_cola() {
+            bool alguna_sana = false;
+            for (auto& c : conexiones) {
+                revisar_conexion(c);
+                if (!sana(c)) continue;
+                alguna_sana = true;
+                while (!c.ocupada && !cola.empty()) {
+                    Pendiente p = std::move(cola.front());
+                    cola.pop_front();
+                    if (!iniciar(c, p)) {
+                        p.callback(nullptr);
+                        break; // Probablemente se cayó: el resto va a las demás conexiones
+                    }
+                }
+            }
+            // Sin conexiones sanas la cola no avanzaría hasta reconectar: fallar rápido
+            while (!alguna_sana && !cola.empty()) {
+                Pendiente p = std::move(cola.front());
+                cola.pop_front();
+                p.callback(nullptr);
+            }
+        }
+        
+        // Empezar o avanzar la reconexión de una conexión libre y caída, sin bloquear
+        void revisar_conexion(Conexion& c) {
+            if (c.ocupada) return;
+            auto ahora = Reloj::now();
+            if (!c.reconectando) {
+                if (PQstatus(c.conn) == CONNECTION_OK || ahora < c.proximo_intento) return;
+                if (!PQresetStart(c.conn)) {
+                    fallo_reconexion(c);
+                    return;
+                }
+                c.reconectando = true;
+                c.sondeo = PGRES_POLLING_WRITING;
+                c.limite_reconexion = ahora + PLAZO_RECONEXION;
+            }
+            if (ahora >= c.limite_reconexion) {
+                fallo_reconexion(c);
+                return;
+            }
+            if (!socket_listo(PQsocket(c.conn), c.sondeo == PGRES_POLLING_READING)) return;
+            c.sondeo = PQresetPoll(c.conn);
+            if (c.sondeo == PGRES_POLLING_FAILED) {
+                fallo_reconexion(c);
+            } else if (c.sondeo == PGRES_POLLING_OK) {
+                PQsetnonblocking(c.conn, 1);
+                c.reconectando = false;
+                c.espera = ESPERA_INICIAL;
+                std::cout << "Conexión async reconectada" << std::endl;
+            }
+        }
+        
+        void fallo_reconexion(Conexion& c) {
+            std::cerr << "Reconexión async fallida: " << PQerrorMessage(c.conn) << std::endl;
+            c.reconectando = false;
+            c.proximo_intento = Reloj::now() + c.espera;
+            c.espera = std::min(c.espera * 2, ESPERA_MAXIMA);
+        }
+        
+        // PQresetPoll solo se llama con el socket listo en la dirección que pidió
+        static bool socket_listo(int sock, bool leer) {
+            if (sock < 0) return false;
+            fd_set fds;
+            FD_ZERO(&fds);
+            FD_SET(sock, &fds);
+            timeval timeout = {0, 0};
+            return select(sock + 1, leer ? &fds : nullptr, leer ? nullptr : &fds, nullptr, &timeout) > 0;
+        }
+        
+        void completar(Conexion& c) {
+            Callback callback = std::move(c.callback);
+            PGresult* res = c.resultado;
+            c.resultado = nullptr;
+            c.ocupada = false;
+            c.callback = nullptr;
+            
+            ExecStatusType estado = res ? PQresultStatus(res) : PGRES_FATAL_ERROR;
+            if (estado != PGRES_TUPLES_OK && estado != PGRES_COMMAND_OK) {
+                std::cerr << "Error en query async: " << PQerrorMessage(c.conn) << std::endl;
+                if (res) PQclear(res);
+                res = nullptr;
+            }
+            callback(res);
+            if (res) PQclear(res);
+        }
+    
+    public:
+        AsyncDatabase(const std::string& conninfo, int num_conexiones = 4) {
+            for (int i = 0; i < num_conexiones; i++) {
+                Conexion c;
+                c.conn = PQconnectdb(conninfo.c_str());
+                if (PQstatus(c.conn) != CONNECTION_OK) {
+                    std::cerr << "Error de conexión async: " << PQerrorMessage(c.conn) << std::endl;
+                    PQfinish(c.conn);
+                    continue;
+                }
+                PQsetnonblocking(c.conn, 1);
+                conexiones.push_back(c);
+            }
+            if (conexiones.empty()) {
+                throw std::runtime_error("No se pudo conectar a PostgreSQL (async)");
+            }
+        }
+        
+        ~AsyncDatabase() {
+            for (auto& c : conexiones) {
+                if (c.resultado) PQclear(c.resultado);
+                PQfinish(c.conn);
+            }
+        }
+        
+        AsyncDatabase(const AsyncDatabase&) = delete;
+        AsyncDatabase& operator=(const AsyncDatabase&) = delete;
+        
+        // Encolar una query parametrizada; el callback se invoca desde procesar()
+        void enviar(const std::string& query, const std::vector<std::string>& params, Callback callback) {
+            cola.push_back({query, params, std::move(callback)});
+            despachar_cola();
+        }
+        
+        // Sockets que el bucle del servidor debe vigilar (lectura para resultados, escritura para flush)
+        void sockets(std::vector<int>& lectura, std::vector<int>& escritura) const {
+            for (const auto& c : conexiones) {
+                if (c.reconectando) {
+                    (c.sondeo == PGRES_POLLING_READING ? lectura : escritura).push_back(PQsocket(c.conn));
+                    continue;
+                }
+                if (!c.ocupada) continue;
+                lectura.push_back(PQsocket(c.conn));
+                if (c.pendiente_flush) escritura.push_back(PQsocket(c.conn));
+            }
+        }
+        
+        // Avanzar todas las conexiones ocupadas sin bloquear, entregar las queries completadas y
+        // seguir con las reconexiones en curso
+        void procesar() {
+            for (auto& c : conexiones) {
+                if (!c.ocupada) continue;
+                
+                if (c.pendiente_flush) {
+                    int r = PQflush(c.conn);
+                    c.pendiente_flush = r == 1;
+                    if (r == -1) {
+                        completar(c);
+                        continue;
+                    }
+                }
+                
+                if (!PQconsumeInput(c.conn)) {
+                    completar(c);
+                    continue;
+                }
+                
+                // Leer todos los resultados disponibles; nullptr marca el fin de la query
+                while (!PQisBusy(c.conn)) {
+                    PGresult* res = PQgetResult(c.conn);
+                    if (!res) {
+                        completar(c);
+                        break;
+                    }
+                    if (c.resultado) PQclear(c.resultado);
+                    c.resultado = res;
+                }
+            }
+            despachar_cola();
+        }
+        
+        size_t en_vuelo() const {
+            size_t n = cola.size();
+            for (const auto& c : conexiones) {
+                if (c.ocupada) n++;
+            }
+            return n;
+        }
+    };
+    
+} // namespace ERP
+
+#endif
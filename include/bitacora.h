@@ -0,0 +1,418 @@
+#ifndef BITACORA_H
+#define BITACORA_H
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <initializer_list>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <thread>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <io.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace ERP {
+    
+    // CRC-32 (IEEE, el de zlib) para detectar registros rotos o truncados
+    inline uint32_t crc32(const char* datos, size_t largo, uint32_t crc = 0) {
+        static const auto tabla = [] {
+            struct { uint32_t v[256]; } t{};
+            for (uint32_t i = 0; i < 256; i++) {
+                uint32_t c = i;
+                for (int k = 0; k < 8; k++) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+                t.v[i] = c;
+            }
+            return t;
+        }();
+        crc = ~crc;
+        for (size_t i = 0; i < largo; i++) crc = tabla.v[(crc ^ (uint8_t)datos[i]) & 0xFF] ^ (crc >> 8);
+        return ~crc;
+    }
+    
+    // Write-ahead log de un almacén en memoria. No interpreta los registros: el almacén los
+    // codifica y decide cómo aplicarlos al recuperar (deben ser idempotentes, p. ej. la
+    // imagen completa de la fila tras el cambio).
+    //
+    // Archivos bajo 'ruta_base':
+    //   <ruta_base>.<n>.wal  registros agregados desde la instantánea de generación n
+    //   <ruta_base>.snap     instantánea compactada: "ERPSNAP1", generación (u64) y registros
+    // Cada registro va enmarcado como [largo u32][crc32 u32][datos]; un marco incompleto o con
+    // CRC inválido al final del último .wal es una escritura cortada por la caída y se descarta.
+    //
+    // Group commit: agregar() solo encola en memoria (se llama bajo el lock del almacén, en el
+    // orden de las mutaciones) y esperar() bloquea hasta que un hilo propio hizo write+fsync
+    // del lote que la contiene. Lo que llega mientras corre un fsync viaja en el siguiente,
+    // así el costo del fsync se reparte entre todas las escrituras concurrentes.
+    class Bitacora {
+    private:
+        std::string ruta_base;
+        size_t umbral_compactacion;
+        std::chrono::microseconds ventana;
+        
+        std::mutex mtx;
+        std::condition_variable hay_trabajo;
+        std::condition_variable durable_cambio;
+        std::string pendiente;   // Marcos aún no escritos
+        uint64_t ultimo = 0;     // Secuencia del último registro agregado
+        uint64_t durable = 0;    // Secuencia hasta la que ya se hizo fsync
+        bool fallida = false;    // Un write/fsync falló: no se garantiza nada más
+        bool detenido = false;
+        std::thread hilo;
+        
+        // La instantánea se arma en otro hilo para no frenar los fsync mientras tanto
+        std::function<void()> compactar;
+        bool compactacion_pedida = false;
+        std::condition_variable hay_compactacion;
+        std::thread hilo_compactacion;
+        
+        std::mutex mtx_archivo;  // Serializa escritura, fsync y rotación del .wal
+        int fd = -1;
+        uint64_t generacion = 0;
+        uint64_t generacion_instantanea = 0;
+        std::atomic<size_t> bytes_wal{0};
+        
+    public:
+        // 'umbral_compactacion': bytes del .wal a partir de los que se pide una instantánea.
+        // 'ventana': espera opcional antes de cada fsync para juntar más escrituras; con 0 el
+        // lote es lo que se acumuló durante el fsync anterior.
+        explicit Bitacora(const std::string& ruta_base_, size_t umbral_compactacion_ = 64 * 1024 * 1024,
+                          std::chrono::microseconds ventana_ = std::chrono::microseconds(0))
+            : ruta_base(ruta_base_), umbral_compactacion(umbral_compactacion_), ventana(ventana_) {}
+        
+        ~Bitacora() {
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+                detenido = true;
+            }
+            hay_trabajo.notify_one();
+            hay_compactacion.notify_one();
+            if (hilo_compactacion.joinable()) hilo_compactacion.join();
+            if (hilo.joinable()) hilo.join();
+            if (fd >= 0) cerrar_archivo(fd);
+        }
+        
+        Bitacora(const Bitacora&) = delete;
+        Bitacora& operator=(const Bitacora&) = delete;
+        
+        // Entregar a por_registro la instantánea y luego los .wal en orden, descartar una cola
+        // cortada y abrir el .wal vigente para agregar. Llamar una sola vez, antes de agregar().
+        bool recuperar(const std::function<void(const char*, size_t)>& por_registro) {
+            std::string datos;
+            if (leer_archivo(ruta_base + ".snap", datos)) {
+                if (datos.size() < 16 || datos.compare(0, 8, "ERPSNAP1") != 0) {
+                    std::cerr << "Instantanea invalida: " << ruta_base << ".snap" << std::endl;
+                    return false;
+                }
+                std::memcpy(&generacion_instantanea, datos.data() + 8, sizeof(uint64_t));
+                if (recorrer_marcos(datos, 16, por_registro) != datos.size()) {
+                    std::cerr << "Instantanea corrupta: " << ruta_base << ".snap" << std::endl;
+                    return false;
+                }
+            }
+            
+            generacion = generacion_instantanea;
+            for (uint64_t g = generacion_instantanea; leer_archivo(ruta_wal(g), datos); g++) {
+                generacion = g;
+                size_t valido = recorrer_marcos(datos, 0, por_registro);
+                if (valido == datos.size()) continue;
+                std::string siguiente;
+                if (leer_archivo(ruta_wal(g + 1), siguiente)) {
+                    std::cerr << "Bitacora corrupta antes del final: " << ruta_wal(g) << std::endl;
+                    return false;
+                }
+                std::cerr << "Descartando " << (datos.size() - valido) << " bytes incompletos de " << ruta_wal(g) << std::endl;
+                if (!truncar(ruta_wal(g), valido)) return false;
+                break;
+            }
+            
+            fd = abrir_para_agregar(ruta_wal(generacion));
+            if (fd < 0) {
+                std::cerr << "No se pudo abrir " << ruta_wal(generacion) << std::endl;
+                return false;
+            }
+            sincronizar_directorio(ruta_wal(generacion));
+            bytes_wal = tamano(fd);
+            hilo = std::thread(&Bitacora::bucle, this);
+            hilo_compactacion = std::thread(&Bitacora::bucle_compactacion, this);
+            return true;
+        }
+        
+        // Pedir una instantánea cuando el .wal supere el umbral. Se invoca desde un hilo propio
+        // de la bitácora; debe capturar el estado, llamar a rotar() y luego a escribir_instantanea().
+        void al_superar_umbral(std::function<void()> compactar_) {
+            std::lock_guard<std::mutex> lock(mtx);
+            compactar = std::move(compactar_);
+        }
+        
+        // Encolar un registro; devuelve su secuencia para esperar()
+        uint64_t agregar(const std::string& registro) {
+            uint64_t secuencia;
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+                enmarcar(pendiente, registro);
+                secuencia = ++ultimo;
+            }
+            hay_trabajo.notify_one();
+            return secuencia;
+        }
+        
+        // Bloquear hasta que el registro 'secuencia' esté en disco; false si la escritura falló
+        bool esperar(uint64_t secuencia) {
+            std::unique_lock<std::mutex> lock(mtx);
+            durable_cambio.wait(lock, [&] { return fallida || durable >= secuencia; });
+            return durable >= secuencia;
+        }
+        
+        // Secuencia hasta la que todo está en disco
+        uint64_t durable_hasta() {
+            std::lock_guard<std::mutex> lock(mtx);
+            return durable;
+        }
+        
+        // false desde el primer write/fsync fallido: no se escribe ni se confirma nada más
+        bool sana() {
+            std::lock_guard<std::mutex> lock(mtx);
+            return !fallida;
+        }
+        
+        // Volcar lo pendiente y pasar a un .wal nuevo. Llamar con el almacén bloqueado para
+        // escritura o lectura, justo después de capturar su estado: la instantánea de ese
+        // estado lleva la generación devuelta.
+        uint64_t rotar() {
+            std::lock_guard<std::mutex> archivo(mtx_archivo);
+            volcar_pendiente();
+            int nuevo = abrir_para_agregar(ruta_wal(generacion + 1));
+            if (nuevo < 0) {
+                std::cerr << "No se pudo abrir " << ruta_wal(generacion + 1) << std::endl;
+                return generacion; // Se sigue en el .wal actual; la instantánea no podrá borrarlo
+            }
+            sincronizar_directorio(ruta_wal(generacion + 1));
+            cerrar_archivo(fd);
+            fd = nuevo;
+            bytes_wal = 0;
+            return ++generacion;
+        }
+        
+        // Escribir la instantánea (marcos ya armados con enmarcar) de forma atómica: archivo
+        // temporal, fsync y rename. Después borra los .wal que quedaron cubiertos.
+        bool escribir_instantanea(const std::string& registros, uint64_t generacion_) {
+            char cabecera[16];
+            std::memcpy(cabecera, "ERPSNAP1", 8);
+            std::memcpy(cabecera + 8, &generacion_, sizeof(uint64_t));
+            if (!escribir_atomico(ruta_base + ".snap", {std::string_view(cabecera, sizeof(cabecera)), registros})) {
+                std::cerr << "No se pudo escribir la instantanea " << ruta_base << ".snap" << std::endl;
+                return false;
+            }
+            for (uint64_t g = generacion_instantanea; g < generacion_; g++) std::remove(ruta_wal(g).c_str());
+            generacion_instantanea = generacion_;
+            return true;
+        }
+        
+        // Reemplazar 'ruta' por la concatenación de 'partes' sin dejar nunca un archivo a medias:
+        // se escribe <ruta>.tmp, fsync y rename
+        static bool escribir_atomico(const std::string& ruta, std::initializer_list<std::string_view> partes) {
+            std::string temporal = ruta + ".tmp";
+            int f = abrir_nuevo(temporal);
+            if (f < 0) return false;
+            bool ok = true;
+            for (std::string_view parte : partes) ok = ok && escribir_todo(f, parte.data(), parte.size());
+            ok = ok && sincronizar(f);
+            cerrar_archivo(f);
+            if (!ok || !reemplazar_archivo(temporal, ruta)) {
+                std::remove(temporal.c_str());
+                return false;
+            }
+            return true;
+        }
+        
+        static void enmarcar(std::string& destino, const std::string& registro) {
+            uint32_t cabecera[2] = {(uint32_t)registro.size(), crc32(registro.data(), registro.size())};
+            destino.append((const char*)cabecera, sizeof(cabecera));
+            destino += registro;
+        }
+        
+    private:
+        void bucle() {
+            std::unique_lock<std::mutex> lock(mtx);
+            while (true) {
+                hay_trabajo.wait(lock, [this] { return detenido || !pendiente.empty(); });
+                if (pendiente.empty()) return; // Detenido y todo en disco
+                if (ventana.count() > 0) hay_trabajo.wait_for(lock, ventana, [this] { return detenido; });
+                lock.unlock();
+                
+                bool crecio;
+                {
+                    std::lock_guard<std::mutex> archivo(mtx_archivo);
+                    volcar_pendiente();
+                    crecio = bytes_wal >= umbral_compactacion;
+                }
+                
+                lock.lock();
+                if (crecio && !compactacion_pedida) {
+                    compactacion_pedida = true;
+                    hay_compactacion.notify_one();
+                }
+            }
+        }
+        
+        void bucle_compactacion() {
+            std::unique_lock<std::mutex> lock(mtx);
+            while (true) {
+                hay_compactacion.wait(lock, [this] { return detenido || compactacion_pedida; });
+                if (detenido) return;
+                std::function<void()> compactar_ = compactar;
+                lock.unlock();
+                if (compactar_) compactar_();
+                lock.lock();
+                compactacion_pedida = false;
+            }
+        }
+        
+        // Requiere mtx_archivo. Tras un fallo no se escribe más: el lote perdido dejaría un hueco
+        // y un fsync posterior que sí funcione no debe dar por durables los registros de antes.
+        void volcar_pendiente() {
+            std::string datos;
+            uint64_t hasta;
+            bool ya_fallida;
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+                datos.swap(pendiente);
+                hasta = ultimo;
+                ya_fallida = fallida;
+            }
+            bool ok = !ya_fallida && (datos.empty() || (escribir_todo(fd, datos.data(), datos.size()) && sincronizar(fd)));
+            if (!ok && !ya_fallida) std::cerr << "Error escribiendo la bitacora " << ruta_wal(generacion) << std::endl;
+            if (ok) bytes_wal += datos.size();
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+                if (ok) durable = hasta;
+                else fallida = true;
+            }
+            durable_cambio.notify_all();
+        }
+        
+        // Recorre los marcos desde 'inicio'; devuelve hasta dónde fueron válidos
+        static size_t recorrer_marcos(const std::string& datos, size_t inicio,
+                                      const std::function<void(const char*, size_t)>& por_registro) {
+            size_t pos = inicio;
+            while (datos.size() - pos >= 8) {
+                uint32_t cabecera[2];
+                std::memcpy(cabecera, datos.data() + pos, sizeof(cabecera));
+                if (datos.size() - pos - 8 < cabecera[0]) break;
+                const char* registro = datos.data() + pos + 8;
+                if (crc32(registro, cabecera[0]) != cabecera[1]) break;
+                por_registro(registro, cabecera[0]);
+                pos += 8 + cabecera[0];
+            }
+            return pos;
+        }
+        
+        std::string ruta_wal(uint64_t g) const {
+            return ruta_base + "." + std::to_string(g) + ".wal";
+        }
+        
+        static bool leer_archivo(const std::string& ruta, std::string& datos) {
+            std::ifstream archivo(ruta, std::ios::binary);
+            if (!archivo) return false;
+            std::ostringstream contenido;
+            contenido << archivo.rdbuf();
+            datos = contenido.str();
+            return true;
+        }
+        
+        // E/S sin buffer de la biblioteca: cada escritura llega al kernel antes del fsync
+        #ifdef _WIN32
+        static int abrir_para_agregar(const std::string& ruta) {
+            return _open(ruta.c_str(), _O_WRONLY | _O_CREAT | _O_APPEND | _O_BINARY, _S_IREAD | _S_IWRITE);
+        }
+        static int abrir_nuevo(const std::string& ruta) {
+            return _open(ruta.c_str(), _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY, _S_IREAD | _S_IWRITE);
+        }
+        static bool escribir_todo(int f, const char* datos, size_t largo) {
+            while (largo > 0) {
+                int n = _write(f, datos, (unsigned)(std::min)(largo, (size_t)1 << 30));
+                if (n <= 0) return false;
+                datos += n;
+                largo -= n;
+            }
+            return true;
+        }
+        static bool sincronizar(int f) { return _commit(f) == 0; }
+        static void cerrar_archivo(int f) { _close(f); }
+        static size_t tamano(int f) { return (size_t)_filelengthi64(f); }
+        static bool truncar(const std::string& ruta, size_t largo) {
+            int f = _open(ruta.c_str(), _O_WRONLY | _O_BINARY);
+            bool ok = f >= 0 && _chsize_s(f, (long long)largo) == 0 && _commit(f) == 0;
+            if (f >= 0) _close(f);
+            return ok;
+        }
+        static bool reemplazar_archivo(const std::string& origen, const std::string& destino) {
+            return MoveFileExA(origen.c_str(), destino.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+        }
+        static void sincronizar_directorio(const std::string&) {}
+        #else
+        static int abrir_para_agregar(const std::string& ruta) {
+            return ::open(ruta.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        }
+        static int abrir_nuevo(const std::string& ruta) {
+            return ::open(ruta.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        }
+        static bool escribir_todo(int f, const char* datos, size_t largo) {
+            while (largo > 0) {
+                ssize_t n = ::write(f, datos, largo);
+                if (n < 0 && errno == EINTR) continue;
+                if (n <= 0) return false;
+                datos += n;
+                largo -= (size_t)n;
+            }
+            return true;
+        }
+        static bool sincronizar(int f) { return ::fsync(f) == 0; }
+        static void cerrar_archivo(int f) { ::close(f); }
+        static size_t tamano(int f) { return (size_t)::lseek(f, 0, SEEK_END); }
+        static bool truncar(const std::string& ruta, size_t largo) {
+            int f = ::open(ruta.c_str(), O_WRONLY | O_CLOEXEC);
+            bool ok = f >= 0 && ::ftruncate(f, (off_t)largo) == 0 && ::fsync(f) == 0;
+            if (f >= 0) ::close(f);
+            return ok;
+        }
+        // rename es atómico; el fsync del directorio hace durable la nueva entrada
+        static bool reemplazar_archivo(const std::string& origen, const std::string& destino) {
+            if (std::rename(origen.c_str(), destino.c_str()) != 0) return false;
+            sincronizar_directorio(destino);
+            return true;
+        }
+        // Sin esto, un archivo recién creado puede no existir tras la caída aunque se le hizo fsync
+        static void sincronizar_directorio(const std::string& ruta) {
+            size_t barra = ruta.find_last_of('/');
+            std::string directorio = barra == std::string::npos ? "." : ruta.substr(0, barra + 1);
+            int d = ::open(directorio.c_str(), O_RDONLY | O_CLOEXEC);
+            if (d >= 0) {
+                ::fsync(d);
+                ::close(d);
+            }
+        }
+        #endif
+    };
+    
+} // namespace ERP
+
+#endif
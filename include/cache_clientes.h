@@ -0,0 +1,331 @@
+#ifndef CACHE_CLIENTES_H
+#define CACHE_CLIENTES_H
+
+#include "cliente.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace ERP {
+    
+    // Caché read-through de obtener_por_id delante de otro almacén (normalmente ClienteDAO).
+    // Las demás operaciones pasan de largo; las escrituras hechas por aquí invalidan lo que
+    // tocan, y las de otros procesos llegan por invalidar() desde LISTEN/NOTIFY.
+    //  - 'fragmentos' particiones por id, cada una con su mutex, su lista LRU y su parte del
+    //    límite en bytes: los aciertos sobre ids distintos casi nunca compiten por el lock.
+    //  - TTL: una entrada vencida cuenta como fallo y se vuelve a leer, por si se perdió una
+    //    notificación.
+    //  - Las lecturas con token de consistencia no usan la caché: eligen una réplica al día.
+    // Una lectura que empezó antes de una invalidación de su fragmento no guarda el resultado,
+    // que puede ser la versión anterior a la escritura. Y si la invalidación trae el token de
+    // la escritura (con réplicas), el fallo siguiente lee con ese token: una réplica atrasada
+    // devolvería la fila vieja y quedaría guardada todo el TTL. La lectura asíncrona no admite
+    // token, así que para esos ids entrega lo leído sin guardarlo.
+    class CacheClientes : public AlmacenClientes {
+    public:
+        struct Estadisticas {
+            long long aciertos = 0;
+            long long fallos = 0;
+            long long desalojos = 0;     // Por el límite de bytes
+            long long vencidos = 0;      // Por TTL
+            long long invalidaciones = 0;
+            long long entradas = 0;
+            long long bytes = 0;
+        };
+        
+    private:
+        using Reloj = std::chrono::steady_clock;
+        
+        struct Entrada {
+            Cliente cliente;
+            Reloj::time_point vence;
+            size_t bytes;
+        };
+        
+        // Token de la última invalidación, hasta que una lectura con él llene la entrada o
+        // pase un TTL (la réplica atrasada más de eso ya es un problema de la replicación)
+        struct Pendiente {
+            std::string token;
+            Reloj::time_point vence;
+        };
+        
+        struct Fragmento {
+            std::mutex mtx;
+            std::list<Entrada> lru; // Más reciente al frente
+            std::unordered_map<int, std::list<Entrada>::iterator> por_id;
+            size_t bytes = 0;
+            uint64_t epoca = 0;     // Se incrementa con cada invalidación
+            std::unordered_map<int, Pendiente> pendientes;
+            Pendiente todos;        // De invalidar_todo(): vale para cualquier id
+        };
+        
+        AlmacenClientes& origen;
+        size_t bytes_por_fragmento;
+        std::chrono::milliseconds ttl;
+        std::vector<std::unique_ptr<Fragmento>> fragmentos;
+        
+        std::atomic<long long> aciertos{0};
+        std::atomic<long long> fallos{0};
+        std::atomic<long long> desalojos{0};
+        std::atomic<long long> vencidos{0};
+        std::atomic<long long> invalidaciones{0};
+        
+    public:
+        // 'fragmentos_' se redondea a potencia de 2
+        CacheClientes(AlmacenClientes& origen_, size_t bytes_maximos,
+                      std::chrono::milliseconds ttl_ = std::chrono::minutes(5), size_t fragmentos_ = 16)
+            : origen(origen_), ttl(ttl_) {
+            size_t n = 1;
+            while (n < fragmentos_) n <<= 1;
+            bytes_por_fragmento = bytes_maximos / n;
+            for (size_t i = 0; i < n; i++) fragmentos.push_back(std::make_unique<Fragmento>());
+        }
+        
+        CacheClientes(const CacheClientes&) = delete;
+        CacheClientes& operator=(const CacheClientes&) = delete;
+        
+        // Descartar un id (p. ej. desde el suscriptor de cambios de la tabla clientes). 'token'
+        // es el de consistencia tomado después de la escritura; vacío sin réplicas.
+        void invalidar(int id, const std::string& token = "") {
+            Fragmento& f = fragmento(id);
+            std::lock_guard<std::mutex> lock(f.mtx);
+            f.epoca++;
+            auto it = f.por_id.find(id);
+            if (it != f.por_id.end()) quitar(f, it->second);
+            if (!token.empty()) {
+                if (f.pendientes.size() >= MAX_PENDIENTES) descartar_vencidos(f);
+                Pendiente& p = f.pendientes[id];
+                anotar(p, token);
+            }
+            invalidaciones++;
+        }
+        
+        void invalidar_todo(const std::string& token = "") {
+            for (auto& f : fragmentos) {
+                std::lock_guard<std::mutex> lock(f->mtx);
+                f->epoca++;
+                f->lru.clear();
+                f->por_id.clear();
+                f->bytes = 0;
+                if (!token.empty()) anotar(f->todos, token);
+            }
+            invalidaciones++;
+        }
+        
+        // Épocas de los fragmentos al empezar una carga masiva (ver precargar)
+        std::vector<uint64_t> marcar() const {
+            std::vector<uint64_t> epocas;
+            epocas.reserve(fragmentos.size());
+            for (const auto& f : fragmentos) {
+                std::lock_guard<std::mutex> lock(f->mtx);
+                epocas.push_back(f->epoca);
+            }
+            return epocas;
+        }
+        
+        // Guardar un cliente leído en bloque después de marcar(); se descarta si su fragmento se
+        // invalidó desde entonces o el id tiene un token pendiente, igual que una lectura
+        // asíncrona. No cuenta como fallo. true si quedó guardado.
+        bool precargar(const Cliente& cliente, const std::vector<uint64_t>& marca) {
+            return guardar(cliente.id, cliente, marca[indice(cliente.id)], false);
+        }
+        
+        Estadisticas estadisticas() const {
+            Estadisticas e;
+            e.aciertos = aciertos;
+            e.fallos = fallos;
+            e.desalojos = desalojos;
+            e.vencidos = vencidos;
+            e.invalidaciones = invalidaciones;
+            for (const auto& f : fragmentos) {
+                std::lock_guard<std::mutex> lock(f->mtx);
+                e.entradas += (long long)f->por_id.size();
+                e.bytes += (long long)f->bytes;
+            }
+            return e;
+        }
+        
+        Cliente obtener_por_id(int id, const std::string& token = "") override {
+            if (!token.empty()) return origen.obtener_por_id(id, token);
+            Cliente cliente;
+            uint64_t epoca;
+            std::string pendiente;
+            if (buscar_en_cache(id, cliente, epoca, pendiente)) return cliente;
+            cliente = origen.obtener_por_id(id, pendiente);
+            guardar(id, cliente, epoca, !pendiente.empty());
+            return cliente;
+        }
+        
+        void obtener_por_id_async(AsyncDatabase& adb, int id, std::function<void(const Cliente&)> callback) override {
+            Cliente cliente;
+            uint64_t epoca;
+            std::string pendiente;
+            if (buscar_en_cache(id, cliente, epoca, pendiente)) {
+                callback(cliente);
+                return;
+            }
+            origen.obtener_por_id_async(adb, id, [this, id, epoca, callback](const Cliente& leido) {
+                guardar(id, leido, epoca, false);
+                callback(leido);
+            });
+        }
+        
+        bool crear(const Cliente& cliente) override {
+            return origen.crear(cliente); // Id nuevo: no hay nada que invalidar
+        }
+        
+        ResultadoActualizacion actualizar(Cliente& cliente) override {
+            ResultadoActualizacion r = origen.actualizar(cliente);
+            invalidar(cliente.id, r == ResultadoActualizacion::Actualizado ? origen.token_consistencia() : "");
+            return r;
+        }
+        
+        // El upsert es por código, no se sabe qué ids cambió
+        ResultadoSincronizacion sincronizar(const std::vector<Cliente>& clientes, size_t tamano_lote = 1000) override {
+            ResultadoSincronizacion r = origen.sincronizar(clientes, tamano_lote);
+            if (r.actualizados > 0) invalidar_todo(origen.token_consistencia());
+            return r;
+        }
+        
+        bool eliminar(int id) override {
+            bool ok = origen.eliminar(id);
+            invalidar(id, ok ? origen.token_consistencia() : "");
+            return ok;
+        }
+        
+        bool recorrer_vistas(int limite, const CursorCliente* despues,
+                             const std::function<bool(const VistaCliente&)>& por_fila,
+                             std::string* siguiente = nullptr, const std::string& token = "",
+                             unsigned campos = CAMPOS_TODOS, const FiltroClientes* filtro = nullptr) override {
+            return origen.recorrer_vistas(limite, despues, por_fila, siguiente, token, campos, filtro);
+        }
+        
+        std::vector<Cliente> buscar(const std::string& texto, int limite) override {
+            return origen.buscar(texto, limite);
+        }
+        
+        bool exportar_csv(const std::function<bool(const char*, size_t)>& consumidor) override {
+            return origen.exportar_csv(consumidor);
+        }
+        
+        long long estimar_activos() override {
+            return origen.estimar_activos();
+        }
+        
+        long long contar_activos() override {
+            return origen.contar_activos();
+        }
+        
+        std::string token_consistencia() override {
+            return origen.token_consistencia();
+        }
+        
+    private:
+        static constexpr size_t MAX_PENDIENTES = 4096; // Por fragmento, antes de barrer los vencidos
+        
+        size_t indice(int id) const {
+            uint32_t h = (uint32_t)id * 2654435761u; // Hash multiplicativo: ids consecutivos se reparten
+            return (h >> 16) & (fragmentos.size() - 1);
+        }
+        
+        Fragmento& fragmento(int id) {
+            return *fragmentos[indice(id)];
+        }
+        
+        // Con acierto copia el cliente y lo pasa al frente de la LRU. Si no, 'epoca' recibe la
+        // del fragmento para que guardar() sepa si hubo invalidaciones mientras tanto, y
+        // 'pendiente' el token con que hay que leer el id (vacío si no hay invalidación pendiente).
+        bool buscar_en_cache(int id, Cliente& cliente, uint64_t& epoca, std::string& pendiente) {
+            Fragmento& f = fragmento(id);
+            std::lock_guard<std::mutex> lock(f.mtx);
+            epoca = f.epoca;
+            auto it = f.por_id.find(id);
+            if (it == f.por_id.end() || Reloj::now() >= it->second->vence) {
+                if (it != f.por_id.end()) {
+                    quitar(f, it->second);
+                    vencidos++;
+                }
+                pendiente = token_pendiente(f, id);
+                fallos++;
+                return false;
+            }
+            f.lru.splice(f.lru.begin(), f.lru, it->second);
+            cliente = it->second->cliente;
+            aciertos++;
+            return true;
+        }
+        
+        // Los inexistentes no se guardan: crear() no sabe qué id va a invalidar. 'con_token': se
+        // leyó con el token pendiente, que ya no hace falta para este id; sin él, una lectura
+        // de un id con token pendiente (asíncrona o precarga) no se guarda.
+        bool guardar(int id, const Cliente& cliente, uint64_t epoca, bool con_token) {
+            if (cliente.id == 0) return false;
+            size_t bytes = tamano(cliente);
+            if (bytes > bytes_por_fragmento) return false;
+            Fragmento& f = fragmento(id);
+            std::lock_guard<std::mutex> lock(f.mtx);
+            if (f.epoca != epoca) return false; // Pudo leerse antes de una escritura
+            if (con_token) f.pendientes.erase(id);
+            else if (!token_pendiente(f, id).empty()) return false;
+            auto it = f.por_id.find(id);
+            if (it != f.por_id.end()) quitar(f, it->second);
+            f.lru.push_front(Entrada{cliente, Reloj::now() + ttl, bytes});
+            f.por_id[id] = f.lru.begin();
+            f.bytes += bytes;
+            while (f.bytes > bytes_por_fragmento) {
+                f.por_id.erase(f.lru.back().cliente.id);
+                f.bytes -= f.lru.back().bytes;
+                f.lru.pop_back();
+                desalojos++;
+            }
+            return true;
+        }
+        
+        // Requiere f.mtx. El token más nuevo entre el del id y el de invalidar_todo() vigentes.
+        static std::string token_pendiente(Fragmento& f, int id) {
+            Reloj::time_point ahora = Reloj::now();
+            const Pendiente* elegido = f.todos.vence > ahora ? &f.todos : nullptr;
+            auto it = f.pendientes.find(id);
+            if (it != f.pendientes.end()) {
+                if (it->second.vence <= ahora) f.pendientes.erase(it);
+                else if (!elegido || Database::parse_lsn(it->second.token) > Database::parse_lsn(elegido->token)) elegido = &it->second;
+            }
+            return elegido ? elegido->token : "";
+        }
+        
+        // Requiere el mtx del fragmento. Los tokens se toman fuera del lock y pueden llegar en
+        // desorden: se conserva el LSN mayor.
+        void anotar(Pendiente& p, const std::string& token) const {
+            if (p.token.empty() || Database::parse_lsn(token) >= Database::parse_lsn(p.token)) p.token = token;
+            p.vence = Reloj::now() + ttl;
+        }
+        
+        static void descartar_vencidos(Fragmento& f) {
+            Reloj::time_point ahora = Reloj::now();
+            for (auto it = f.pendientes.begin(); it != f.pendientes.end();) {
+                if (it->second.vence <= ahora) it = f.pendientes.erase(it);
+                else ++it;
+            }
+        }
+        
+        static void quitar(Fragmento& f, std::list<Entrada>::iterator it) {
+            f.bytes -= it->bytes;
+            f.por_id.erase(it->cliente.id);
+            f.lru.erase(it);
+        }
+        
+        // Aproximado: la entrada, sus textos y el nodo de la lista y del mapa
+        static size_t tamano(const Cliente& c) {
+            return sizeof(Entrada) + 64 + c.codigo.capacity() + c.razon_social.capacity() + c.ruc.capacity() +
+                   c.direccion.capacity() + c.telefono.capacity() + c.email.capacity();
+        }
+    };
+    
+} // namespace ERP
+
+#endif
@@ -0,0 +1,131 @@
+#ifndef CACHE_LISTADO_H
+#define CACHE_LISTADO_H
+
+#include "database.h"
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace ERP {
+    
+    // Respuesta del listado completo ya serializada, una por máscara de campos, con la versión
+    // de los datos con que se armó. invalidar() sube la versión en cada escritura (propia o
+    // notificada) y cada respuesta vence además a los 'vigencia' de armada, por si se perdieron
+    // notificaciones o no hay LISTEN. La primera
+    // petición posterior reconstruye y las que llegan mientras tanto esperan esa misma
+    // reconstrucción en vez de lanzar otra. Servir una respuesta vigente es solo copiar o
+    // escribir sus bytes, y el shared_ptr la mantiene viva aunque se reemplace durante el envío.
+    class CacheListado {
+    public:
+        using Cuerpo = std::shared_ptr<const std::string>;
+        // Arma el JSON completo en 'json'; 'token' es el de la última escritura (vacío si no hay)
+        using Constructor = std::function<bool(std::string& json, const std::string& token)>;
+        
+    private:
+        struct Entrada {
+            Cuerpo cuerpo;
+            uint64_t version = 0;
+            std::chrono::steady_clock::time_point vence;
+            bool construyendo = false;
+        };
+        
+        std::mutex mtx;
+        std::condition_variable construida;
+        std::map<unsigned, Entrada> por_campos;
+        uint64_t version = 1;
+        std::string token; // Para leer la propia escritura si la reconstrucción va a una réplica
+        size_t bytes = 0;
+        size_t bytes_maximos;
+        std::chrono::milliseconds vigencia;
+        
+    public:
+        // Si las respuestas guardadas superan 'bytes_maximos' se descartan las de otras máscaras
+        explicit CacheListado(size_t bytes_maximos_ = 256u << 20,
+                              std::chrono::milliseconds vigencia_ = std::chrono::minutes(5))
+            : bytes_maximos(bytes_maximos_), vigencia(vigencia_) {}
+        
+        CacheListado(const CacheListado&) = delete;
+        CacheListado& operator=(const CacheListado&) = delete;
+        
+        // Llamar después de cada escritura confirmada (propia o notificada), con su token de
+        // consistencia si lo hay. Los tokens pueden llegar en desorden: se conserva el LSN mayor.
+        void invalidar(const std::string& token_ = "") {
+            std::lock_guard<std::mutex> lock(mtx);
+            version++;
+            if (!token_.empty() && (token.empty() || Database::parse_lsn(token_) >= Database::parse_lsn(token))) token = token_;
+        }
+        
+        // Respuesta vigente para 'campos', reconstruida con 'construir' si hubo escrituras desde
+        // la última. nullptr si la reconstrucción falló (no se guarda nada) o si se venció el
+        // PlazoPeticion esperando la reconstrucción de otro.
+        Cuerpo obtener(unsigned campos, const Constructor& construir) {
+            PlazoPeticion* plazo = PlazoPeticion::actual();
+            auto limite = std::chrono::steady_clock::now() + std::chrono::milliseconds(plazo ? plazo->restante_ms() : 0);
+            std::unique_lock<std::mutex> lock(mtx);
+            Entrada& e = por_campos[campos];
+            while (true) {
+                if (e.cuerpo && e.version == version && std::chrono::steady_clock::now() < e.vence) return e.cuerpo;
+                if (!e.construyendo) break;
+                if (!plazo) construida.wait(lock);
+                else if (construida.wait_until(lock, limite) == std::cv_status::timeout) return nullptr;
+            }
+            
+            e.construyendo = true;
+            uint64_t version_inicio = version;
+            auto inicio = std::chrono::steady_clock::now();
+            std::string token_inicio = token;
+            lock.unlock();
+            
+            auto json = std::make_shared<std::string>();
+            bool ok = false;
+            try {
+                ok = construir(*json, token_inicio);
+            } catch (...) {
+                terminar(campos, nullptr, version_inicio, inicio);
+                throw;
+            }
+            Cuerpo cuerpo = ok ? Cuerpo(std::move(json)) : nullptr;
+            terminar(campos, cuerpo, version_inicio, inicio);
+            return cuerpo;
+        }
+        
+    private:
+        // Una escritura durante la reconstrucción deja 'version_inicio' atrás: la respuesta se
+        // entrega a quien la pidió pero la próxima petición vuelve a construir. La vigencia
+        // cuenta desde que empezó la lectura.
+        void terminar(unsigned campos, const Cuerpo& cuerpo, uint64_t version_inicio,
+                      std::chrono::steady_clock::time_point inicio) {
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+                Entrada& e = por_campos[campos];
+                e.construyendo = false;
+                if (cuerpo) {
+                    if (e.cuerpo) bytes -= e.cuerpo->size();
+                    if (bytes + cuerpo->size() > bytes_maximos) descartar_otras(campos);
+                    e.cuerpo = cuerpo;
+                    e.version = version_inicio;
+                    e.vence = inicio + vigencia;
+                    bytes += cuerpo->size();
+                }
+            }
+            construida.notify_all();
+        }
+        
+        // Requiere mtx
+        void descartar_otras(unsigned campos) {
+            for (auto& par : por_campos) {
+                if (par.first == campos || !par.second.cuerpo) continue;
+                bytes -= par.second.cuerpo->size();
+                par.second.cuerpo.reset();
+            }
+        }
+    };
+    
+} // namespace ERP
+
+#endif
@@ -2,11 +2,116 @@
 #define CLIENTE_H
 
 #include "database.h"
+#include "repositorio.h"
+#include "transaccion.h"
+#include "async_database.h"
+#include "imagen_clientes.h"
 #include <string>
 #include <vector>
+#include <map>
+#include <optional>
+#include <algorithm>
+#include <string_view>
 
 namespace ERP {
     
+    // Campos de Cliente seleccionables con ?fields= (máscara de bits). El nombre JSON coincide
+    // con la columna; el orden de la tabla es el orden de las columnas en el SELECT.
+    enum CampoCliente : unsigned {
+        CAMPO_ID           = 1u << 0,
+        CAMPO_CODIGO       = 1u << 1,
+        CAMPO_RAZON_SOCIAL = 1u << 2,
+        CAMPO_RUC          = 1u << 3,
+        CAMPO_DIRECCION    = 1u << 4,
+        CAMPO_TELEFONO     = 1u << 5,
+        CAMPO_EMAIL        = 1u << 6,
+        CAMPO_ACTIVO       = 1u << 7,
+        CAMPO_VERSION      = 1u << 8,
+        CAMPOS_TODOS       = (1u << 9) - 1
+    };
+    
+    struct DescriptorCampo {
+        unsigned bit;
+        const char* nombre;
+    };
+    
+    inline constexpr DescriptorCampo CAMPOS_CLIENTE[] = {
+        {CAMPO_ID, "id"}, {CAMPO_CODIGO, "codigo"}, {CAMPO_RAZON_SOCIAL, "razon_social"},
+        {CAMPO_RUC, "ruc"}, {CAMPO_DIRECCION, "direccion"}, {CAMPO_TELEFONO, "telefono"},
+        {CAMPO_EMAIL, "email"}, {CAMPO_ACTIVO, "activo"}, {CAMPO_VERSION, "version"},
+    };
+    
+    // "id,codigo,razon_social" -> máscara; vacío = todos. false si hay un campo desconocido.
+    inline bool parse_campos(const std::string& lista, unsigned& campos) {
+        if (lista.empty()) {
+            campos = CAMPOS_TODOS;
+            return true;
+        }
+        campos = 0;
+        size_t inicio = 0;
+        while (inicio <= lista.size()) {
+            size_t fin = lista.find(',', inicio);
+            if (fin == std::string::npos) fin = lista.size();
+            std::string nombre = lista.substr(inicio, fin - inicio);
+            bool encontrado = false;
+            for (const auto& d : CAMPOS_CLIENTE) {
+                if (nombre == d.nombre) {
+                    campos |= d.bit;
+                    encontrado = true;
+                    break;
+                }
+            }
+            if (!encontrado) return false;
+            inicio = fin + 1;
+        }
+        return true;
+    }
+    
+    // Lista de columnas para el SELECT, en el orden de CAMPOS_CLIENTE
+    inline std::string columnas_cliente(unsigned campos) {
+        std::string columnas;
+        for (const auto& d : CAMPOS_CLIENTE) {
+            if (!(campos & d.bit)) continue;
+            if (!columnas.empty()) columnas += ", ";
+            columnas += d.nombre;
+        }
+        return columnas;
+    }
+    
+    // Posición en el SELECT (y en Entidad<Cliente>::columnas) del campo con ese bit
+    constexpr size_t posicion_campo(unsigned bit) {
+        size_t i = 0;
+        while (bit > 1) { bit >>= 1; i++; }
+        return i;
+    }
+    
+    // Campo CSV: entre comillas (duplicándolas) solo si hace falta. Como COPY, la cadena
+    // vacía va entre comillas para distinguirla de NULL.
+    inline void agregar_csv(std::string& destino, std::string_view valor) {
+        if (!valor.empty() && valor.find_first_of(",\"\r\n") == std::string_view::npos) {
+            destino += valor;
+            return;
+        }
+        destino += '"';
+        for (char c : valor) {
+            if (c == '"') destino += '"';
+            destino += c;
+        }
+        destino += '"';
+    }
+    
+    // Agregar texto a una cadena JSON escapando comillas, barras y saltos de línea
+    inline void agregar_escapado(std::string& json, std::string_view texto) {
+        for (char c : texto) {
+            if (c == '"') json += "\\\"";
+            else if (c == '\\') json += "\\\\";
+            else if (c == '\n') json += "\\n";
+            else if (c == '\r') json += "\\r";
+            else if (c == '\t') json += "\\t";
+            else json += c;
+        }
+    }
+    
     struct Cliente {
         int id = 0;
         std::string codigo;
@@ -16,140 +121,755 @@ namespace ERP {
         std::string telefono;
         std::string email;
         bool activo = true;
+        int version = 0; // Se incrementa en cada UPDATE (trigger trg_clientes_version)
         
-        // Convertir a JSON string
-        std::string to_json() const {
-            std::string json = "{";
-            json += "\"id\":" + std::to_string(id) + ",";
-            json += "\"codigo\":\"" + codigo + "\",";
-            json += "\"razon_social\":\"" + escape_json(razon_social) + "\",";
-            json += "\"ruc\":\"" + ruc + "\",";
-            json += "\"direccion\":\"" + escape_json(direccion) + "\",";
-            json += "\"telefono\":\"" + telefono + "\",";
-            json += "\"email\":\"" + email + "\",";
-            json += "\"activo\":" + std::string(activo ? "true" : "false");
-            json += "}";
-            return json;
+        // Convertir a JSON string con los campos de la máscara (todos por defecto)
+        std::string to_json(unsigned campos = CAMPOS_TODOS) const {
+            std::string json;
+            if (campos & CAMPO_ID) json += ",\"id\":" + std::to_string(id);
+            if (campos & CAMPO_CODIGO) json += ",\"codigo\":\"" + codigo + "\"";
+            if (campos & CAMPO_RAZON_SOCIAL) json += ",\"razon_social\":\"" + escape_json(razon_social) + "\"";
+            if (campos & CAMPO_RUC) json += ",\"ruc\":\"" + ruc + "\"";
+            if (campos & CAMPO_DIRECCION) json += ",\"direccion\":\"" + escape_json(direccion) + "\"";
+            if (campos & CAMPO_TELEFONO) json += ",\"telefono\":\"" + telefono + "\"";
+            if (campos & CAMPO_EMAIL) json += ",\"email\":\"" + email + "\"";
+            if (campos & CAMPO_ACTIVO) json += ",\"activo\":" + std::string(activo ? "true" : "false");
+            if (campos & CAMPO_VERSION) json += ",\"version\":" + std::to_string(version);
+            if (json.empty()) return "{}";
+            json[0] = '{';
+            return json + "}";
         }
         
     private:
         std::string escape_json(const std::string& str) const {
             std::string result;
-            for (char c : str) {
-                if (c == '"') result += "\\\"";
-                else if (c == '\\') result += "\\\\";
-                else if (c == '\n') result += "\\n";
-                else if (c == '\r') result += "\\r";
-                else if (c == '\t') result += "\\t";
-                else result += c;
+            agregar_escapado(result, str);
+            return result;
+        }
+    };
+    
+    template <>
+    struct Entidad<Cliente> {
+        static constexpr const char* tabla = "clientes";
+        static constexpr auto columnas = std::make_tuple(
+            columna("id", &Cliente::id, COLUMNA_CLAVE),
+            columna("codigo", &Cliente::codigo),
+            columna("razon_social", &Cliente::razon_social),
+            columna("ruc", &Cliente::ruc),
+            columna("direccion", &Cliente::direccion),
+            columna("telefono", &Cliente::telefono),
+            columna("email", &Cliente::email),
+            columna("activo", &Cliente::activo),
+            columna("version", &Cliente::version, COLUMNA_GENERADA));
+    };
+    
+    // Los bits de CampoCliente son posiciones en Entidad<Cliente>::columnas: así
+    // Repositorio<Cliente>::leer decodifica también las filas proyectadas con ?fields=
+    constexpr bool campos_cliente_alineados() {
+        size_t i = 0;
+        for (const auto& d : CAMPOS_CLIENTE) {
+            if (d.bit != (1u << i) || !sql::iguales(d.nombre, sql::nombre_columna<Cliente>(i))) return false;
+            i++;
+        }
+        return i == Repositorio<Cliente>::NUM_COLUMNAS && CAMPOS_TODOS == Repositorio<Cliente>::TODAS;
+    }
+    static_assert(campos_cliente_alineados(), "CAMPOS_CLIENTE no coincide con Entidad<Cliente>::columnas");
+    
+    // Cliente leído en el lugar desde el PGresult (ver VistaFila): los listados se serializan
+    // sin crear un std::string por campo ni copiar el Cliente. Un almacén sin PGresult
+    // (AlmacenMemoria) entrega en cambio vistas sobre su registro inmutable compartido.
+    class VistaCliente : public VistaFila<Cliente> {
+    private:
+        std::shared_ptr<const Cliente> registro;
+        std::shared_ptr<const ImagenClientes> imagen; // Con 'en_imagen': fila de una imagen mapeada
+        const RegistroImagen* en_imagen = nullptr;
+        
+    public:
+        using VistaFila<Cliente>::VistaFila;
+        
+        explicit VistaCliente(std::shared_ptr<const Cliente> registro_) : registro(std::move(registro_)) {}
+        
+        VistaCliente(std::shared_ptr<const ImagenClientes> imagen_, const RegistroImagen& r)
+            : imagen(std::move(imagen_)), en_imagen(&r) {}
+        
+        int id() const {
+            if (en_imagen) return en_imagen->id;
+            return registro ? registro->id : entero(posicion_campo(CAMPO_ID));
+        }
+        std::string_view codigo() const { return campo(&Cliente::codigo, CAMPO_CODIGO); }
+        std::string_view razon_social() const { return campo(&Cliente::razon_social, CAMPO_RAZON_SOCIAL); }
+        std::string_view ruc() const { return campo(&Cliente::ruc, CAMPO_RUC); }
+        std::string_view direccion() const { return campo(&Cliente::direccion, CAMPO_DIRECCION); }
+        std::string_view telefono() const { return campo(&Cliente::telefono, CAMPO_TELEFONO); }
+        std::string_view email() const { return campo(&Cliente::email, CAMPO_EMAIL); }
+        bool activo() const {
+            if (en_imagen) return en_imagen->activo != 0;
+            return registro ? registro->activo : booleano(posicion_campo(CAMPO_ACTIVO));
+        }
+        int version() const {
+            if (en_imagen) return en_imagen->version;
+            return registro ? registro->version : entero(posicion_campo(CAMPO_VERSION));
+        }
+        
+        Cliente materializar() const {
+            if (en_imagen) {
+                Cliente c;
+                c.id = id();
+                c.codigo = codigo();
+                c.razon_social = razon_social();
+                c.ruc = ruc();
+                c.direccion = direccion();
+                c.telefono = telefono();
+                c.email = email();
+                c.activo = activo();
+                c.version = version();
+                return c;
+            }
+            return registro ? *registro : VistaFila<Cliente>::materializar();
+        }
+        
+        // Mismo JSON que Cliente::to_json(campos), agregado al final de 'json'. Desde un
+        // PGresult los enteros se copian tal como los envió PostgreSQL, sin convertirlos.
+        void agregar_json(std::string& json, unsigned campos = CAMPOS_TODOS) const {
+            size_t inicio = json.size();
+            if (campos & CAMPO_ID) {
+                json += ",\"id\":";
+                agregar_entero(json, &Cliente::id, CAMPO_ID);
+            }
+            if (campos & CAMPO_CODIGO) agregar_cadena(json, ",\"codigo\":\"", codigo(), false);
+            if (campos & CAMPO_RAZON_SOCIAL) agregar_cadena(json, ",\"razon_social\":\"", razon_social(), true);
+            if (campos & CAMPO_RUC) agregar_cadena(json, ",\"ruc\":\"", ruc(), false);
+            if (campos & CAMPO_DIRECCION) agregar_cadena(json, ",\"direccion\":\"", direccion(), true);
+            if (campos & CAMPO_TELEFONO) agregar_cadena(json, ",\"telefono\":\"", telefono(), false);
+            if (campos & CAMPO_EMAIL) agregar_cadena(json, ",\"email\":\"", email(), false);
+            if (campos & CAMPO_ACTIVO) {
+                json += ",\"activo\":";
+                json += activo() ? "true" : "false";
+            }
+            if (campos & CAMPO_VERSION) {
+                json += ",\"version\":";
+                agregar_entero(json, &Cliente::version, CAMPO_VERSION);
+            }
+            if (json.size() == inicio) {
+                json += "{}";
+                return;
+            }
+            json[inicio] = '{';
+            json += '}';
+        }
+        
+    private:
+        // En la imagen los textos van en el orden de las columnas, sin el id
+        std::string_view campo(std::string Cliente::* miembro, unsigned bit) const {
+            if (en_imagen) return imagen->texto(*en_imagen, posicion_campo(bit) - 1);
+            return registro ? std::string_view((*registro).*miembro) : texto(posicion_campo(bit));
+        }
+        
+        void agregar_entero(std::string& json, int Cliente::* miembro, unsigned bit) const {
+            if (en_imagen) json += std::to_string(bit == CAMPO_ID ? en_imagen->id : en_imagen->version);
+            else if (registro) json += std::to_string((*registro).*miembro);
+            else json += texto(posicion_campo(bit));
+        }
+        
+        static void agregar_cadena(std::string& json, const char* clave, std::string_view valor, bool escapar) {
+            json += clave;
+            if (escapar) agregar_escapado(json, valor);
+            else json += valor;
+            json += '"';
+        }
+    };
+    
+    // Posición opaca para paginación por clave (keyset): última (razon_social, id) entregada
+    struct CursorCliente {
+        std::string razon_social;
+        int id = 0;
+        
+        // Codificar como base64url de "id:razon_social" para que sea seguro en la query string
+        std::string codificar() const {
+            static const char* alfabeto = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+            std::string plano = std::to_string(id) + ":" + razon_social;
+            std::string result;
+            size_t i = 0;
+            for (; i + 2 < plano.size(); i += 3) {
+                unsigned v = ((unsigned char)plano[i] << 16) | ((unsigned char)plano[i + 1] << 8) | (unsigned char)plano[i + 2];
+                result += alfabeto[(v >> 18) & 63];
+                result += alfabeto[(v >> 12) & 63];
+                result += alfabeto[(v >> 6) & 63];
+                result += alfabeto[v & 63];
+            }
+            if (i + 1 == plano.size()) {
+                unsigned v = (unsigned char)plano[i] << 16;
+                result += alfabeto[(v >> 18) & 63];
+                result += alfabeto[(v >> 12) & 63];
+            } else if (i + 2 == plano.size()) {
+                unsigned v = ((unsigned char)plano[i] << 16) | ((unsigned char)plano[i + 1] << 8);
+                result += alfabeto[(v >> 18) & 63];
+                result += alfabeto[(v >> 12) & 63];
+                result += alfabeto[(v >> 6) & 63];
             }
             return result;
         }
+        
+        static bool decodificar(const std::string& texto, CursorCliente& cursor) {
+            std::string plano;
+            unsigned v = 0;
+            int bits = 0;
+            for (char c : texto) {
+                int d;
+                if (c >= 'A' && c <= 'Z') d = c - 'A';
+                else if (c >= 'a' && c <= 'z') d = c - 'a' + 26;
+                else if (c >= '0' && c <= '9') d = c - '0' + 52;
+                else if (c == '-') d = 62;
+                else if (c == '_') d = 63;
+                else return false;
+                v = (v << 6) | (unsigned)d;
+                bits += 6;
+                if (bits >= 8) {
+                    bits -= 8;
+                    plano += (char)((v >> bits) & 0xFF);
+                }
+            }
+            
+            size_t sep = plano.find(':');
+            if (sep == std::string::npos || sep == 0) return false;
+            try {
+                cursor.id = std::stoi(plano.substr(0, sep));
+            } catch (...) {
+                return false;
+            }
+            cursor.razon_social = plano.substr(sep + 1);
+            return true;
+        }
+    };
+    
+    // Filtros del listado (?ruc=, ?codigo_prefix=, ?activo=, ?updated_after=). Cada uno se traduce
+    // a una condición parametrizada sobre una columna indexada: ruc (idx_clientes_ruc), prefijo de
+    // codigo (idx_clientes_codigo_patron) y fecha_actualizacion (idx_clientes_fecha_actualizacion).
+    struct FiltroClientes {
+        enum class Activo { Si, No, Todos };
+        Activo activo = Activo::Si;
+        std::string ruc;
+        std::string codigo_prefijo;
+        std::string actualizado_despues; // Timestamp ISO 8601, ya validado
+        
+        bool por_defecto() const {
+            return activo == Activo::Si && ruc.empty() && codigo_prefijo.empty() && actualizado_despues.empty();
+        }
     };
     
-    class ClienteDAO {
+    struct PaginaClientes {
+        std::vector<Cliente> clientes;
+        std::string siguiente; // Cursor de la próxima página; vacío si no hay más
+    };
+    
+    // Sentencia emitida por el DAO, expuesta para el verificador de planes
+    struct SentenciaDAO {
+        const char* nombre;
+        const char* sql;
+    };
+    
+    struct ResultadoSincronizacion {
+        int insertados = 0;
+        int actualizados = 0;
+        int sin_cambios = 0;     // Ya existían con los mismos datos: no se reescriben
+        int lotes_fallidos = 0;  // Lotes rechazados completos (p. ej. RUC duplicado con otro código)
+    };
+    
+    enum class ResultadoActualizacion { Actualizado, Conflicto, NoEncontrado, Error };
+    
+    // Motor de almacenamiento que usan ClienteController y ContadorClientes: PostgreSQL
+    // (ClienteDAO), en memoria (AlmacenMemoria, almacen_memoria.h) para despliegues sin base
+    // y benchmarks, o una imagen mapeada de solo lectura (AlmacenImagen, almacen_imagen.h).
+    // Las operaciones tienen la semántica documentada en ClienteDAO.
+    class AlmacenClientes {
+    public:
+        virtual ~AlmacenClientes() = default;
+        
+        virtual bool crear(const Cliente& cliente) = 0;
+        virtual Cliente obtener_por_id(int id, const std::string& token = "") = 0;
+        virtual bool recorrer_vistas(int limite, const CursorCliente* despues,
+                                     const std::function<bool(const VistaCliente&)>& por_fila,
+                                     std::string* siguiente = nullptr, const std::string& token = "",
+                                     unsigned campos = CAMPOS_TODOS, const FiltroClientes* filtro = nullptr) = 0;
+        virtual std::vector<Cliente> buscar(const std::string& texto, int limite) = 0;
+        virtual ResultadoActualizacion actualizar(Cliente& cliente) = 0;
+        virtual ResultadoSincronizacion sincronizar(const std::vector<Cliente>& clientes, size_t tamano_lote = 1000) = 0;
+        virtual bool eliminar(int id) = 0;
+        virtual bool exportar_csv(const std::function<bool(const char*, size_t)>& consumidor) = 0;
+        virtual long long estimar_activos() = 0;
+        virtual long long contar_activos() = 0;
+        
+        // Token para leer las propias escrituras (solo con réplicas)
+        virtual std::string token_consistencia() {
+            return "";
+        }
+        
+        // Sin conexiones no bloqueantes se responde en el acto con obtener_por_id
+        virtual void obtener_por_id_async(AsyncDatabase& /*adb*/, int id, std::function<void(const Cliente&)> callback) {
+            callback(obtener_por_id(id));
+        }
+        
+        // Obtener todos los clientes activos (solo los campos de la máscara)
+        std::vector<Cliente> obtener_todos(unsigned campos = CAMPOS_TODOS) {
+            std::vector<Cliente> clientes;
+            recorrer_vistas(0, nullptr, [&](const VistaCliente& fila) {
+                clientes.push_back(fila.materializar());
+                return true;
+            }, nullptr, "", campos);
+            return clientes;
+        }
+        
+        // Como recorrer_vistas, pero copiando cada fila a un Cliente
+        bool recorrer(int limite, const CursorCliente* despues,
+                      const std::function<bool(const Cliente&)>& por_cliente,
+                      std::string* siguiente = nullptr, const std::string& token = "",
+                      unsigned campos = CAMPOS_TODOS, const FiltroClientes* filtro = nullptr) {
+            return recorrer_vistas(limite, despues, [&](const VistaCliente& fila) {
+                return por_cliente(fila.materializar());
+            }, siguiente, token, campos, filtro);
+        }
+        
+        // Obtener una página de clientes activos a partir del cursor (keyset sobre razon_social, id).
+        // En PostgreSQL usa idx_clientes_razon_social_id_cubriente, así que el costo no depende de
+        // la profundidad de la página.
+        PaginaClientes obtener_pagina(int limite, const CursorCliente* despues = nullptr,
+                                      unsigned campos = CAMPOS_TODOS) {
+            PaginaClientes pagina;
+            pagina.clientes.reserve(limite);
+            recorrer_vistas(limite, despues, [&](const VistaCliente& fila) {
+                pagina.clientes.push_back(fila.materializar());
+                return true;
+            }, &pagina.siguiente, "", campos);
+            return pagina;
+        }
+    };
+    
+    class ClienteDAO : public AlmacenClientes {
     private:
+        using Repo = Repositorio<Cliente>;
+        
         Database& db;
+        Repo repositorio;
+        EscritorAgrupado* escritor = nullptr;
+        
+        // Lo que sigue a "SELECT <columnas de Entidad<Cliente>> FROM clientes" en cada lectura
+        static constexpr char DESPUES_PAGINA[] =
+            " WHERE activo = true ORDER BY razon_social, id LIMIT $1";
+        static constexpr char DESPUES_PAGINA_DESPUES[] =
+            " WHERE activo = true AND (razon_social, id) > ($1, $2) ORDER BY razon_social, id LIMIT $3";
+        static constexpr char DESPUES_BUSCAR[] =
+            " WHERE activo = true "
+            "AND (razon_social ILIKE $2 OR codigo ILIKE $2 OR ruc ILIKE $2 OR razon_social % $1) "
+            "ORDER BY GREATEST(similarity(razon_social, $1), similarity(codigo, $1), similarity(ruc, $1)) DESC, "
+            "razon_social, id LIMIT $3";
         
     public:
-        ClienteDAO(Database& database) : db(database) {}
+        // Filas por consulta al recorrer el listado completo (ver recorrer_completo)
+        static constexpr int LOTE_LISTADO = 1000;
+        
+        // Todas las sentencias que emite el DAO. Al agregar una nueva, sumarla a sentencias()
+        // para que el verificador de planes (verificador_planes.h) la cubra.
+        static constexpr const char* SQL_CREAR = Repo::SQL_INSERTAR.c_str();
+        static constexpr const char* SQL_PAGINA = Repo::SELECT_CON<DESPUES_PAGINA>.c_str();
+        static constexpr const char* SQL_PAGINA_DESPUES = Repo::SELECT_CON<DESPUES_PAGINA_DESPUES>.c_str();
+        // Formato fijo del CSV exportado: no sigue al descriptor (sin version)
+        static constexpr const char* SQL_EXPORTAR =
+            "SELECT id, codigo, razon_social, ruc, direccion, telefono, email, activo "
+            "FROM clientes WHERE activo = true ORDER BY id";
+        static constexpr const char* SQL_POR_ID = Repo::SQL_POR_CLAVE.c_str();
+        // Coincidencia parcial ($2 = %texto%) o por similitud ($1) sobre los índices trigram,
+        // ordenada por la mejor similitud entre los tres campos
+        static constexpr const char* SQL_BUSCAR = Repo::SELECT_CON<DESPUES_BUSCAR>.c_str();
+        // Concurrencia optimista: solo actualiza un cliente activo que siga en la versión leída
+        // ($8). Sin fila devuelta, SQL_VERSION_VIGENTE distingue conflicto de inexistente.
+        static constexpr const char* SQL_ACTUALIZAR =
+            "UPDATE clientes SET codigo = $1, razon_social = $2, ruc = $3, direccion = $4, "
+            "telefono = $5, email = $6, fecha_actualizacion = CURRENT_TIMESTAMP "
+            "WHERE id = $7 AND version = $8 AND activo = true RETURNING version";
+        // Sentencia aparte y no subconsulta del UPDATE: en READ COMMITTED la subconsulta lee el
+        // snapshot del UPDATE y, si el conflicto lo causó un commit concurrente, devolvería la
+        // misma versión que mandó el cliente. Una sentencia nueva ve ese commit.
+        static constexpr const char* SQL_VERSION_VIGENTE =
+            "SELECT version FROM clientes WHERE id = $1 AND activo = true";
+        // Upsert de un lote con un arreglo por columna; solo reescribe filas que cambiaron. Un
+        // código dado de baja que vuelve a llegar se reactiva: el lote es el maestro vigente.
+        // (xmax = 0) distingue filas insertadas de actualizadas en el RETURNING.
+        static constexpr const char* SQL_SINCRONIZAR =
+            "INSERT INTO clientes AS c (codigo, razon_social, ruc, direccion, telefono, email) "
+            "SELECT * FROM unnest($1::varchar[], $2::varchar[], $3::varchar[], $4::text[], $5::varchar[], $6::varchar[]) "
+            "ON CONFLICT (codigo) DO UPDATE SET razon_social = EXCLUDED.razon_social, ruc = EXCLUDED.ruc, "
+            "direccion = EXCLUDED.direccion, telefono = EXCLUDED.telefono, email = EXCLUDED.email, "
+            "activo = true, fecha_actualizacion = CURRENT_TIMESTAMP "
+            "WHERE (c.razon_social, c.ruc, c.direccion, c.telefono, c.email, c.activo) IS DISTINCT FROM "
+            "(EXCLUDED.razon_social, EXCLUDED.ruc, EXCLUDED.direccion, EXCLUDED.telefono, EXCLUDED.email, true) "
+            "RETURNING (xmax = 0) AS insertado";
+        static constexpr const char* SQL_CONTAR =
+            "SELECT count(*) FROM clientes WHERE activo = true";
+        // Solo planifica: filas estimadas a partir de pg_class.reltuples y las estadísticas de activo
+        static constexpr const char* SQL_ESTIMAR =
+            "EXPLAIN (FORMAT JSON) SELECT 1 FROM clientes WHERE activo = true";
+        static constexpr const char* SQL_ELIMINAR =
+            "UPDATE clientes SET activo = false, fecha_actualizacion = CURRENT_TIMESTAMP WHERE id = $1";
+        
+        static std::vector<SentenciaDAO> sentencias() {
+            return {
+                {"crear", SQL_CREAR},
+                {"listar", SQL_PAGINA_DESPUES}, // Cada lote del listado completo, con LIMIT LOTE_LISTADO
+                {"pagina", SQL_PAGINA},
+                {"pagina_despues", SQL_PAGINA_DESPUES},
+                {"exportar", SQL_EXPORTAR},
+                {"por_id", SQL_POR_ID},
+                {"buscar", SQL_BUSCAR},
+                {"actualizar", SQL_ACTUALIZAR},
+                {"version_vigente", SQL_VERSION_VIGENTE},
+                {"sincronizar", SQL_SINCRONIZAR},
+                {"contar", SQL_CONTAR},
+                {"eliminar", SQL_ELIMINAR},
+            };
+        }
+        
+        ClienteDAO(Database& database) : db(database), repositorio(database) {}
+        
+        // Activar group commit para crear/eliminar (nullptr lo desactiva)
+        void usar_escritor_agrupado(EscritorAgrupado* escritor_agrupado) {
+            escritor = escritor_agrupado;
+        }
         
         // Crear cliente
-        bool crear(const Cliente& cliente) {
-            std::string query = "INSERT INTO clientes (codigo, razon_social, ruc, direccion, telefono, email) "
-                              "VALUES ('" + escape_sql(cliente.codigo) + "', "
-                              "'" + escape_sql(cliente.razon_social) + "', "
-                              "'" + escape_sql(cliente.ruc) + "', "
-                              "'" + escape_sql(cliente.direccion) + "', "
-                              "'" + escape_sql(cliente.telefono) + "', "
-                              "'" + escape_sql(cliente.email) + "')";
+        bool crear(const Cliente& cliente) override {
+            return escribir(SQL_CREAR, Repo::parametros_escritura(cliente));
+        }
+        
+        // Recorrer clientes activos en orden (razon_social, id) a medida que llegan de una réplica,
+        // como vistas sobre cada PGresult (sin copiar los campos).
+        // limite <= 0 recorre todos (despues requiere limite); con limite, 'siguiente' recibe el
+        // cursor de la próxima página. Con token de consistencia solo se lee de una réplica que ya aplicó esa escritura.
+        // 'campos' limita las columnas leídas (id y razon_social se leen siempre para el cursor);
+        // el resto de los campos queda vacío. Con filtro se listan los clientes que lo cumplen
+        // en lugar de todos los activos.
+        bool recorrer_vistas(int limite, const CursorCliente* despues,
+                             const std::function<bool(const VistaCliente&)>& por_fila,
+                             std::string* siguiente = nullptr, const std::string& token = "",
+                             unsigned campos = CAMPOS_TODOS, const FiltroClientes* filtro = nullptr) override {
+            campos |= CAMPO_ID | CAMPO_RAZON_SOCIAL;
+            std::string sql;
+            std::vector<std::string> params;
+            if (filtro && !filtro->por_defecto()) {
+                sql = sql_filtrado(*filtro, campos, despues, limite, params);
+            } else if (limite <= 0) {
+                return recorrer_completo(por_fila, token, campos);
+            } else {
+                // Se pide una fila extra para saber si existe una página siguiente
+                std::string limite_sql = std::to_string(limite + 1);
+                const char* query = SQL_PAGINA;
+                params = {limite_sql};
+                if (despues) {
+                    query = SQL_PAGINA_DESPUES;
+                    params = {despues->razon_social, std::to_string(despues->id), limite_sql};
+                }
+                sql = campos == CAMPOS_TODOS ? std::string(query) : proyectar(query, campos);
+            }
             
-            return db.execute(query);
+            int entregadas = 0;
+            bool resueltas = false;
+            VistaCliente::Columnas columnas;
+            VistaCliente ultima; // Retiene solo el PGresult de la última fila, para el cursor
+            bool ok = db.query_stream(sql, params, [&](const ResultadoCompartido& res) {
+                if (limite > 0 && entregadas == limite) {
+                    if (siguiente) {
+                        CursorCliente cursor;
+                        cursor.razon_social = std::string(ultima.razon_social());
+                        cursor.id = ultima.id();
+                        *siguiente = cursor.codificar();
+                    }
+                    return true;
+                }
+                // Todas las filas del modo single-row tienen la misma forma: PQfnumber una sola vez
+                if (!resueltas) {
+                    columnas = VistaCliente::columnas(res.get());
+                    resueltas = true;
+                }
+                ultima = VistaCliente(res, columnas);
+                entregadas++;
+                return por_fila(ultima);
+            }, Destino::Replica, token);
+            return ok;
         }
         
-        // Obtener todos los clientes activos
-        std::vector<Cliente> obtener_todos() {
-            std::vector<Cliente> clientes;
-            std::string query = "SELECT id, codigo, razon_social, ruc, direccion, telefono, email, activo "
-                              "FROM clientes WHERE activo = true ORDER BY razon_social";
+        // Exportar clientes activos como CSV, bloque a bloque, sin materializarlos en memoria
+        bool exportar_csv(const std::function<bool(const char*, size_t)>& consumidor) override {
+            std::string query = std::string("COPY (") + SQL_EXPORTAR + ") TO STDOUT WITH (FORMAT csv, HEADER true)";
             
-            PGresult* res = db.query(query);
+            // Agrupar las filas de COPY en bloques de ~64KB para no emitir un chunk HTTP por fila
+            const size_t tam_bloque = 64 * 1024;
+            std::string bloque;
+            bloque.reserve(tam_bloque);
+            
+            bool ok = db.copy_out(query, [&](const char* data, size_t len) {
+                bloque.append(data, len);
+                if (bloque.size() < tam_bloque) return true;
+                bool seguir = consumidor(bloque.data(), bloque.size());
+                bloque.clear();
+                return seguir;
+            }, Destino::Replica);
+            
+            if (ok && !bloque.empty()) ok = consumidor(bloque.data(), bloque.size());
+            return ok;
+        }
+        
+        // Obtener cliente por ID
+        Cliente obtener_por_id(int id, const std::string& token = "") override {
+            Cliente cliente;
+            repositorio.obtener(id, cliente, Destino::Replica, token); // Vacío si no existe
+            return cliente;
+        }
+        
+        // Buscar clientes activos por fragmento de razón social, código o RUC (los N más parecidos)
+        std::vector<Cliente> buscar(const std::string& texto, int limite) override {
+            std::vector<Cliente> clientes;
+            PGresult* res = db.query(SQL_BUSCAR, {texto, "%" + escape_like(texto) + "%", std::to_string(limite)},
+                                     Destino::Replica);
             if (!res) return clientes;
             
             int rows = PQntuples(res);
+            clientes.reserve(rows);
             for (int i = 0; i < rows; i++) {
-                Cliente c;
-                c.id = std::stoi(PQgetvalue(res, i, 0));
-                c.codigo = PQgetvalue(res, i, 1);
-                c.razon_social = PQgetvalue(res, i, 2);
-                c.ruc = PQgetvalue(res, i, 3);
-                c.direccion = PQgetvalue(res, i, 4);
-                c.telefono = PQgetvalue(res, i, 5);
-                c.email = PQgetvalue(res, i, 6);
-                c.activo = (PQgetvalue(res, i, 7)[0] == 't');
-                
-                clientes.push_back(c);
+                clientes.push_back(Repo::leer(res, i));
             }
-            
             PQclear(res);
             return clientes;
         }
         
-        // Obtener cliente por ID
-        Cliente obtener_por_id(int id) {
-            Cliente cliente;
-            std::string query = "SELECT id, codigo, razon_social, ruc, direccion, telefono, email, activo "
-                              "FROM clientes WHERE id = " + std::to_string(id);
+        // Obtener cliente por ID sin bloquear: el callback recibe el cliente (vacío si no existe)
+        // cuando el bucle de eventos procesa el resultado
+        void obtener_por_id_async(AsyncDatabase& adb, int id, std::function<void(const Cliente&)> callback) override {
+            adb.enviar(SQL_POR_ID, {std::to_string(id)}, [this, callback](PGresult* res) {
+                if (!res || PQntuples(res) == 0) {
+                    callback(Cliente());
+                    return;
+                }
+                callback(Repo::leer(res, 0));
+            });
+        }
+        
+        // Actualizar cliente si sigue en cliente.version (la versión que leyó quien edita).
+        // Al volver, cliente.version queda con la versión nueva o, en conflicto, con la vigente.
+        ResultadoActualizacion actualizar(Cliente& cliente) override {
+            PGresult* res = db.query(SQL_ACTUALIZAR, {cliente.codigo, cliente.razon_social, cliente.ruc,
+                                                      cliente.direccion, cliente.telefono, cliente.email,
+                                                      std::to_string(cliente.id), std::to_string(cliente.version)});
+            if (!res) return ResultadoActualizacion::Error;
+            if (PQntuples(res) == 1) {
+                cliente.version = std::stoi(PQgetvalue(res, 0, 0));
+                PQclear(res);
+                return ResultadoActualizacion::Actualizado;
+            }
+            PQclear(res);
             
-            PGresult* res = db.query(query);
-            if (!res || PQntuples(res) == 0) {
-                if (res) PQclear(res);
-                return cliente; // Retorna cliente vacío
+            // Solo en el camino de conflicto: segunda ida y vuelta para leer la versión vigente
+            res = db.query(SQL_VERSION_VIGENTE, {std::to_string(cliente.id)});
+            if (!res) return ResultadoActualizacion::Error;
+            ResultadoActualizacion resultado = ResultadoActualizacion::NoEncontrado;
+            if (PQntuples(res) == 1) {
+                cliente.version = std::stoi(PQgetvalue(res, 0, 0));
+                resultado = ResultadoActualizacion::Conflicto;
             }
+            PQclear(res);
+            return resultado;
+        }
+        
+        // Sincronizar clientes por código en lotes de tamano_lote filas: una sentencia por lote
+        // en lugar de una lectura más un crear/actualizar por fila. Cada sentencia ya es atómica;
+        // solo dentro de una transacción del llamador cada lote abre un savepoint, así un lote
+        // rechazado no aborta los demás.
+        ResultadoSincronizacion sincronizar(const std::vector<Cliente>& clientes, size_t tamano_lote = 1000) override {
+            ResultadoSincronizacion resultado;
             
-            cliente.id = std::stoi(PQgetvalue(res, 0, 0));
-            cliente.codigo = PQgetvalue(res, 0, 1);
-            cliente.razon_social = PQgetvalue(res, 0, 2);
-            cliente.ruc = PQgetvalue(res, 0, 3);
-            cliente.direccion = PQgetvalue(res, 0, 4);
-            cliente.telefono = PQgetvalue(res, 0, 5);
-            cliente.email = PQgetvalue(res, 0, 6);
-            cliente.activo = (PQgetvalue(res, 0, 7)[0] == 't');
+            // Un mismo código dos veces en un lote haría fallar ON CONFLICT: gana la última aparición
+            std::vector<const Cliente*> unicos;
+            std::map<std::string, size_t> posicion;
+            for (const auto& c : clientes) {
+                auto it = posicion.find(c.codigo);
+                if (it != posicion.end()) {
+                    unicos[it->second] = &c;
+                    continue;
+                }
+                posicion[c.codigo] = unicos.size();
+                unicos.push_back(&c);
+            }
             
+            if (tamano_lote == 0) tamano_lote = 1000;
+            for (size_t inicio = 0; inicio < unicos.size(); inicio += tamano_lote) {
+                size_t fin = std::min(inicio + tamano_lote, unicos.size());
+                std::vector<std::string> codigos, razones, rucs, direcciones, telefonos, emails;
+                for (size_t i = inicio; i < fin; i++) {
+                    codigos.push_back(unicos[i]->codigo);
+                    razones.push_back(unicos[i]->razon_social);
+                    rucs.push_back(unicos[i]->ruc);
+                    direcciones.push_back(unicos[i]->direccion);
+                    telefonos.push_back(unicos[i]->telefono);
+                    emails.push_back(unicos[i]->email);
+                }
+                
+                std::optional<Transaccion> savepoint;
+                if (db.en_transaccion()) savepoint.emplace(db);
+                PGresult* res = !savepoint || savepoint->activa()
+                                    ? db.query(SQL_SINCRONIZAR, {array_literal(codigos), array_literal(razones),
+                                                                 array_literal(rucs), array_literal(direcciones),
+                                                                 array_literal(telefonos), array_literal(emails)})
+                                    : nullptr;
+                if (!res || (savepoint && !savepoint->confirmar())) {
+                    if (res) PQclear(res);
+                    resultado.lotes_fallidos++;
+                    continue;
+                }
+                int rows = PQntuples(res);
+                for (int i = 0; i < rows; i++) {
+                    if (PQgetvalue(res, i, 0)[0] == 't') resultado.insertados++;
+                    else resultado.actualizados++;
+                }
+                resultado.sin_cambios += (int)(fin - inicio) - rows;
+                PQclear(res);
+            }
+            return resultado;
+        }
+        
+        // Cantidad aproximada de clientes activos según el planificador; -1 si falla
+        long long estimar_activos() override {
+            PGresult* res = db.query(SQL_ESTIMAR, Destino::Replica);
+            if (!res) return -1;
+            std::string plan = PQgetvalue(res, 0, 0);
             PQclear(res);
-            return cliente;
+            size_t pos = plan.find("\"Plan Rows\":");
+            if (pos == std::string::npos) return -1;
+            return std::atoll(plan.c_str() + pos + 12);
         }
         
-        // Actualizar cliente
-        bool actualizar(const Cliente& cliente) {
-            std::string query = "UPDATE clientes SET "
-                              "codigo = '" + escape_sql(cliente.codigo) + "', "
-                              "razon_social = '" + escape_sql(cliente.razon_social) + "', "
-                              "ruc = '" + escape_sql(cliente.ruc) + "', "
-                              "direccion = '" + escape_sql(cliente.direccion) + "', "
-                              "telefono = '" + escape_sql(cliente.telefono) + "', "
-                              "email = '" + escape_sql(cliente.email) + "', "
-                              "fecha_actualizacion = CURRENT_TIMESTAMP "
-                              "WHERE id = " + std::to_string(cliente.id);
-            
-            return db.execute(query);
+        // Conteo exacto de clientes activos (recorre el índice parcial); -1 si falla.
+        // No usar en el camino de una petición: ver ContadorClientes.
+        long long contar_activos() override {
+            PGresult* res = db.query(SQL_CONTAR, Destino::Replica);
+            if (!res) return -1;
+            long long total = std::atoll(PQgetvalue(res, 0, 0));
+            PQclear(res);
+            return total;
+        }
+        
+        // Token para leer las propias escrituras desde réplicas (vacío si no hay réplicas)
+        std::string token_consistencia() override {
+            return db.token_consistencia();
         }
         
         // Eliminación lógica
-        bool eliminar(int id) {
-            std::string query = "UPDATE clientes SET activo = false, "
-                              "fecha_actualizacion = CURRENT_TIMESTAMP "
-                              "WHERE id = " + std::to_string(id);
-            
-            return db.execute(query);
+        bool eliminar(int id) override {
+            return escribir(SQL_ELIMINAR, {std::to_string(id)});
         }
         
     private:
-        std::string escape_sql(const std::string& str) {
+        // Escritura sin retorno: por el escritor agrupado si está activo, salvo que el hilo ya
+        // esté dentro de una Transaccion (se une a ella; el escritor no podría tomar el primario)
+        bool escribir(const char* sql, const std::vector<std::string>& params) {
+            if (escritor && !db.en_transaccion()) return escritor->escribir(sql, params);
+            return db.execute(sql, params);
+        }
+        
+        // SELECT del listado con las condiciones del filtro; los valores van siempre como parámetros
+        static std::string sql_filtrado(const FiltroClientes& filtro, unsigned campos, const CursorCliente* despues,
+                                        int limite, std::vector<std::string>& params) {
+            auto parametro = [&](const std::string& valor) {
+                params.push_back(valor);
+                return "$" + std::to_string(params.size());
+            };
+            
+            std::vector<std::string> condiciones;
+            if (filtro.activo != FiltroClientes::Activo::Todos) {
+                condiciones.push_back(filtro.activo == FiltroClientes::Activo::Si ? "activo = true" : "activo = false");
+            }
+            if (!filtro.ruc.empty()) {
+                condiciones.push_back("ruc = " + parametro(filtro.ruc));
+            }
+            if (!filtro.codigo_prefijo.empty()) {
+                condiciones.push_back("codigo LIKE " + parametro(escape_like(filtro.codigo_prefijo) + "%"));
+            }
+            if (!filtro.actualizado_despues.empty()) {
+                condiciones.push_back("fecha_actualizacion > " + parametro(filtro.actualizado_despues) + "::timestamp");
+            }
+            if (despues) {
+                std::string razon_social = parametro(despues->razon_social);
+                std::string id = parametro(std::to_string(despues->id));
+                condiciones.push_back("(razon_social, id) > (" + razon_social + ", " + id + ")");
+            }
+            
+            std::string sql = "SELECT " + columnas_cliente(campos) + " FROM clientes";
+            for (size_t i = 0; i < condiciones.size(); i++) {
+                sql += (i == 0 ? " WHERE " : " AND ") + condiciones[i];
+            }
+            sql += " ORDER BY razon_social, id";
+            if (limite > 0) sql += " LIMIT " + parametro(std::to_string(limite + 1));
+            return sql;
+        }
+        
+        // Listado completo por keyset, en lotes de LOTE_LISTADO: cada consulta es un Limit(Index
+        // Scan) sobre idx_clientes_razon_social_id_cubriente y la primera fila sale enseguida.
+        // Una sola consulta sin LIMIT pasa a Sort(Seq Scan), con el sort a disco, en cuanto la
+        // tabla crece. Cada lote es su propio snapshot: una escritura durante el recorrido se
+        // ve como al paginar con ?after=.
+        bool recorrer_completo(const std::function<bool(const VistaCliente&)>& por_fila, const std::string& token,
+                               unsigned campos) {
+            std::string pagina = campos == CAMPOS_TODOS ? std::string(SQL_PAGINA) : proyectar(SQL_PAGINA, campos);
+            std::string pagina_despues = campos == CAMPOS_TODOS ? std::string(SQL_PAGINA_DESPUES)
+                                                                : proyectar(SQL_PAGINA_DESPUES, campos);
+            std::string lote = std::to_string(LOTE_LISTADO);
+            VistaCliente ultima;
+            for (bool primero = true;; primero = false) {
+                std::vector<std::string> params = {lote};
+                if (!primero) params = {std::string(ultima.razon_social()), std::to_string(ultima.id()), lote};
+                int filas = 0;
+                bool resueltas = false;
+                VistaCliente::Columnas columnas;
+                bool ok = db.query_stream(primero ? pagina : pagina_despues, params, [&](const ResultadoCompartido& res) {
+                    if (!resueltas) {
+                        columnas = VistaCliente::columnas(res.get());
+                        resueltas = true;
+                    }
+                    ultima = VistaCliente(res, columnas);
+                    filas++;
+                    return por_fila(ultima);
+                }, Destino::Replica, token);
+                if (!ok) return false;
+                if (filas < LOTE_LISTADO) return true;
+            }
+        }
+        
+        // Reemplazar la lista de columnas de una sentencia SQL_* por las de la máscara
+        static std::string proyectar(const char* sql, unsigned campos) {
+            std::string original = sql;
+            size_t desde = original.find(" FROM ");
+            return "SELECT " + columnas_cliente(campos) + original.substr(desde);
+        }
+        
+        // Literal de arreglo de PostgreSQL: {"a","b"} con comillas y barras escapadas
+        static std::string array_literal(const std::vector<std::string>& valores) {
+            std::string result = "{";
+            for (size_t i = 0; i < valores.size(); i++) {
+                if (i > 0) result += ',';
+                result += '"';
+                for (char c : valores[i]) {
+                    if (c == '"' || c == '\\') result += '\\';
+                    result += c;
+                }
+                result += '"';
+            }
+            result += '}';
+            return result;
+        }
+        
+        // Escapar comodines de LIKE para que el texto buscado se tome literal
+        static std::string escape_like(const std::string& str) {
             std::string result;
             for (char c : str) {
-                if (c == '\'') result += "''";
-                else result += c;
+                if (c == '%' || c == '_' || c == '\\') result += '\\';
+                result += c;
             }
             return result;
         }
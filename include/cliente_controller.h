@@ -2,22 +2,168 @@
 #define CLIENTE_CONTROLLER_H
 
 #include "cliente.h"
+#include "contador_clientes.h"
+#include "cache_clientes.h"
+#include "cache_listado.h"
+#include "precarga.h"
+#include "json.hpp"
 #include <string>
+#include <functional>
 
 namespace ERP {
     
+    // Parámetros de GET /api/clientes tal como llegan en la query string
+    struct ParametrosListado {
+        std::string limit;
+        std::string after;
+        std::string token;
+        std::string fields;
+        std::string ruc;
+        std::string codigo_prefix;
+        std::string activo;        // true (por defecto), false o todos
+        std::string updated_after; // AAAA-MM-DD o AAAA-MM-DDTHH:MM[:SS]
+    };
+    
     class ClienteController {
     private:
-        ClienteDAO& dao;
+        AlmacenClientes& dao;
+        CacheListado listado; // Respuestas del listado completo (sin paginar ni filtrar)
+        
+        static constexpr const char* ERROR_CAMPOS =
+            "{\"exito\":false,\"mensaje\":\"fields admite: id, codigo, razon_social, ruc, direccion, "
+            "telefono, email, activo, version\",\"codigo_error\":400}";
         
     public:
-        ClienteController(ClienteDAO& cliente_dao) : dao(cliente_dao) {}
+        // 'vigencia_listado': máximo que se sirve el listado completo armado sin volver a leerlo
+        ClienteController(AlmacenClientes& cliente_dao, std::chrono::milliseconds vigencia_listado = std::chrono::minutes(5))
+            : dao(cliente_dao), listado(256u << 20, vigencia_listado) {}
+        
+        // Listar todos los clientes (fields = lista de campos separados por coma; vacío = todos).
+        // Sale de la respuesta ya serializada mientras no haya escrituras ni venza su vigencia.
+        std::string listar_todos(const std::string& fields = "") {
+            unsigned campos;
+            if (!parse_campos(fields, campos)) return ERROR_CAMPOS;
+            auto cuerpo = listado_completo(campos);
+            return cuerpo ? *cuerpo : "{\"exito\":false,\"mensaje\":\"Error al obtener clientes\",\"codigo_error\":500}";
+        }
         
-        // Listar todos los clientes
-        std::string listar_todos() {
-            auto clientes = dao.obtener_todos();
+        // Llamar desde el suscriptor de cambios de la tabla clientes (escrituras de otros procesos),
+        // con el LSN actual del primario como token: la reconstrucción no puede ver menos que eso
+        void invalidar_listado(const std::string& token = "") {
+            listado.invalidar(token);
+        }
+        
+        // Listar una página de clientes (limit=1..1000, after=cursor opaco de la página anterior)
+        std::string listar_pagina(const std::string& limit, const std::string& after, const std::string& fields = "") {
+            unsigned campos;
+            if (!parse_campos(fields, campos)) return ERROR_CAMPOS;
+            int limite;
+            CursorCliente cursor;
+            std::string error = parse_paginacion(limit, after, limite, cursor);
+            if (!error.empty()) return error;
             
             std::string json = "{\"exito\":true,\"mensaje\":\"Clientes obtenidos exitosamente\",\"datos\":[";
+            std::string siguiente;
+            bool primero = true;
+            dao.recorrer_vistas(limite, after.empty() ? nullptr : &cursor, [&](const VistaCliente& fila) {
+                if (!primero) json += ",";
+                fila.agregar_json(json, campos);
+                primero = false;
+                return true;
+            }, &siguiente, "", campos);
+            json += "],\"siguiente\":";
+            json += siguiente.empty() ? "null" : "\"" + siguiente + "\"";
+            json += "}";
+            
+            return json;
+        }
+        
+        // Listar clientes serializando cada fila apenas llega de PostgreSQL.
+        // Sin limit ni after se listan todos; con fields solo se leen y emiten esos campos; los
+        // filtros (ruc, codigo_prefix, activo, updated_after) se aplican en la base.
+        // Devuelve false si la respuesta quedó incompleta.
+        bool listar_stream(const ParametrosListado& p, const std::function<bool(const char*, size_t)>& write) {
+            unsigned campos;
+            if (!parse_campos(p.fields, campos)) {
+                std::string error = ERROR_CAMPOS;
+                return write(error.data(), error.size());
+            }
+            
+            FiltroClientes filtro;
+            std::string error = parse_filtro(p, filtro);
+            if (!error.empty()) return write(error.data(), error.size());
+            
+            int limite = 0;
+            CursorCliente cursor;
+            if (!p.limit.empty() || !p.after.empty()) {
+                error = parse_paginacion(p.limit, p.after, limite, cursor);
+                if (!error.empty()) return write(error.data(), error.size());
+            }
+            
+            // El listado completo sin filtros se escribe de una vez desde la respuesta cacheada
+            if (limite == 0 && filtro.por_defecto() && p.token.empty()) {
+                auto cuerpo = listado_completo(campos);
+                if (cuerpo) return write(cuerpo->data(), cuerpo->size());
+                std::string error = "{\"exito\":false,\"mensaje\":\"Error al obtener clientes\",\"codigo_error\":500}";
+                return write(error.data(), error.size());
+            }
+            
+            const size_t tam_bloque = 16 * 1024;
+            std::string buffer = "{\"exito\":true,\"mensaje\":\"Clientes obtenidos exitosamente\",\"datos\":[";
+            buffer.reserve(tam_bloque + 1024);
+            bool primero = true;
+            bool enviado = false;
+            bool cliente_conectado = true;
+            
+            std::string siguiente;
+            bool ok = dao.recorrer_vistas(limite, p.after.empty() ? nullptr : &cursor, [&](const VistaCliente& fila) {
+                if (!primero) buffer += ",";
+                fila.agregar_json(buffer, campos);
+                primero = false;
+                if (buffer.size() >= tam_bloque) {
+                    cliente_conectado = write(buffer.data(), buffer.size());
+                    buffer.clear();
+                    enviado = true;
+                }
+                return cliente_conectado;
+            }, limite > 0 ? &siguiente : nullptr, p.token, campos, &filtro);
+            
+            if (!ok) {
+                if (enviado || !cliente_conectado) return false;
+                std::string error = "{\"exito\":false,\"mensaje\":\"Error al obtener clientes\",\"codigo_error\":500}";
+                return write(error.data(), error.size());
+            }
+            
+            buffer += "]";
+            if (limite > 0) {
+                buffer += ",\"siguiente\":";
+                buffer += siguiente.empty() ? "null" : "\"" + siguiente + "\"";
+            }
+            buffer += "}";
+            return write(buffer.data(), buffer.size());
+        }
+        
+        // Buscar clientes por similitud (q de al menos 3 caracteres, limit=1..100)
+        std::string buscar(const std::string& q, const std::string& limit) {
+            if (q.size() < 3) {
+                return "{\"exito\":false,\"mensaje\":\"La busqueda requiere al menos 3 caracteres\",\"codigo_error\":400}";
+            }
+            
+            int limite = 20;
+            if (!limit.empty()) {
+                try {
+                    limite = std::stoi(limit);
+                } catch (...) {
+                    limite = 0;
+                }
+                if (limite < 1 || limite > 100) {
+                    return "{\"exito\":false,\"mensaje\":\"limit debe estar entre 1 y 100\",\"codigo_error\":400}";
+                }
+            }
+            
+            auto clientes = dao.buscar(q, limite);
+            
+            std::string json = "{\"exito\":true,\"mensaje\":\"Busqueda completada\",\"datos\":[";
             for (size_t i = 0; i < clientes.size(); i++) {
                 json += clientes[i].to_json();
                 if (i < clientes.size() - 1) json += ",";
@@ -27,9 +173,62 @@ namespace ERP {
             return json;
         }
         
+        // Cantidad de clientes activos: estimación del planificador y, si ya se calculó, el conteo
+        // exacto cacheado con su antigüedad. No consulta la base.
+        std::string contar(const ContadorClientes& contador) {
+            auto l = contador.leer();
+            if (l.estimado < 0 && l.exacto < 0) {
+                return "{\"exito\":false,\"mensaje\":\"Conteo aun no disponible\",\"codigo_error\":503}";
+            }
+            
+            std::string json = "{\"exito\":true,\"mensaje\":\"Conteo de clientes\",\"datos\":{";
+            json += "\"estimado\":" + std::to_string(l.estimado >= 0 ? l.estimado : l.exacto);
+            json += ",\"exacto\":" + (l.exacto >= 0 ? std::to_string(l.exacto) : std::string("null"));
+            json += ",\"antiguedad_ms\":" + (l.exacto >= 0 ? std::to_string(l.antiguedad_ms) : std::string("null"));
+            json += ",\"vigente\":" + std::string(l.vigente ? "true" : "false");
+            json += "}}";
+            return json;
+        }
+        
+        // Para el balanceador: listo cuando terminó la precarga (o no hay). Mientras tanto
+        // codigo_error 503 con el avance.
+        std::string preparado(const PrecargaClientes* precarga) {
+            if (!precarga) return "{\"exito\":true,\"mensaje\":\"Servidor listo\"}";
+            auto i = precarga->informe();
+            std::string datos = "\"datos\":{\"precarga\":\"" + std::string(PrecargaClientes::nombre(i.estado)) + "\"";
+            datos += ",\"filas\":" + std::to_string(i.filas);
+            datos += ",\"filas_descartadas\":" + std::to_string(i.filas_descartadas);
+            datos += ",\"duracion_ms\":" + std::to_string(i.duracion_ms);
+            datos += ",\"filas_por_segundo\":" + std::to_string((long long)i.filas_por_segundo);
+            datos += ",\"conexiones\":" + std::to_string(i.conexiones);
+            datos += ",\"rangos\":" + std::to_string(i.rangos);
+            datos += ",\"rangos_fallidos\":" + std::to_string(i.rangos_fallidos) + "}";
+            if (!precarga->lista()) {
+                return "{\"exito\":false,\"mensaje\":\"Precarga en curso\",\"codigo_error\":503," + datos + "}";
+            }
+            return "{\"exito\":true,\"mensaje\":\"Servidor listo\"," + datos + "}";
+        }
+        
+        // Contadores de la caché de obtener_por_id
+        std::string estadisticas_cache(const CacheClientes& cache) {
+            auto e = cache.estadisticas();
+            long long lecturas = e.aciertos + e.fallos;
+            std::string json = "{\"exito\":true,\"mensaje\":\"Estadisticas de cache\",\"datos\":{";
+            json += "\"aciertos\":" + std::to_string(e.aciertos);
+            json += ",\"fallos\":" + std::to_string(e.fallos);
+            json += ",\"tasa_aciertos\":" + std::to_string(lecturas > 0 ? (double)e.aciertos / lecturas : 0.0);
+            json += ",\"desalojos\":" + std::to_string(e.desalojos);
+            json += ",\"vencidos\":" + std::to_string(e.vencidos);
+            json += ",\"invalidaciones\":" + std::to_string(e.invalidaciones);
+            json += ",\"entradas\":" + std::to_string(e.entradas);
+            json += ",\"bytes\":" + std::to_string(e.bytes);
+            json += "}}";
+            return json;
+        }
+        
         // Obtener cliente por ID
-        std::string obtener_por_id(int id) {
-            auto cliente = dao.obtener_por_id(id);
+        std::string obtener_por_id(int id, const std::string& token = "") {
+            auto cliente = dao.obtener_por_id(id, token);
             
             if (cliente.id == 0) {
                 return "{\"exito\":false,\"mensaje\":\"Cliente no encontrado\",\"codigo_error\":404}";
@@ -38,6 +237,17 @@ namespace ERP {
             return "{\"exito\":true,\"mensaje\":\"Cliente encontrado\",\"datos\":" + cliente.to_json() + "}";
         }
         
+        // Obtener cliente por ID de forma diferida; 'responder' recibe el JSON final
+        void obtener_por_id_async(AsyncDatabase& adb, int id, std::function<void(const std::string&)> responder) {
+            dao.obtener_por_id_async(adb, id, [responder](const Cliente& cliente) {
+                if (cliente.id == 0) {
+                    responder("{\"exito\":false,\"mensaje\":\"Cliente no encontrado\",\"codigo_error\":404}");
+                    return;
+                }
+                responder("{\"exito\":true,\"mensaje\":\"Cliente encontrado\",\"datos\":" + cliente.to_json() + "}");
+            });
+        }
+        
         // Crear nuevo cliente
         std::string crear(const std::string& cliente_json) {
             // Parseo simple del JSON (implementar parser más robusto después)
@@ -48,22 +258,210 @@ namespace ERP {
             }
             
             if (dao.crear(cliente)) {
-                return "{\"exito\":true,\"mensaje\":\"Cliente creado exitosamente\"}";
+                return "{\"exito\":true,\"mensaje\":\"Cliente creado exitosamente\"" + confirmar_escritura() + "}";
             } else {
                 return "{\"exito\":false,\"mensaje\":\"Error al crear cliente\",\"codigo_error\":500}";
             }
         }
         
+        // Sincronizar un arreglo JSON de clientes (upsert por código) en lotes de 'lote' filas
+        std::string sincronizar(const std::string& clientes_json, const std::string& lote) {
+            std::vector<Cliente> clientes;
+            try {
+                auto datos = nlohmann::json::parse(clientes_json);
+                if (!datos.is_array()) {
+                    return "{\"exito\":false,\"mensaje\":\"Se esperaba un arreglo de clientes\",\"codigo_error\":400}";
+                }
+                clientes.reserve(datos.size());
+                for (const auto& d : datos) {
+                    Cliente c = leer_cliente(d);
+                    if (c.codigo.empty() || c.razon_social.empty()) {
+                        return "{\"exito\":false,\"mensaje\":\"Código y razón social son requeridos\",\"codigo_error\":400}";
+                    }
+                    clientes.push_back(std::move(c));
+                }
+            } catch (const std::exception&) {
+                return "{\"exito\":false,\"mensaje\":\"JSON invalido\",\"codigo_error\":400}";
+            }
+            
+            size_t tamano_lote = 1000;
+            if (!lote.empty()) {
+                try {
+                    tamano_lote = (size_t)std::stoul(lote);
+                } catch (...) {}
+                if (tamano_lote < 1 || tamano_lote > 10000) tamano_lote = 1000;
+            }
+            
+            auto r = dao.sincronizar(clientes, tamano_lote);
+            std::string json = "{\"exito\":" + std::string(r.lotes_fallidos == 0 ? "true" : "false") +
+                               ",\"mensaje\":\"Sincronizacion completada\",\"datos\":{" +
+                               "\"insertados\":" + std::to_string(r.insertados) +
+                               ",\"actualizados\":" + std::to_string(r.actualizados) +
+                               ",\"sin_cambios\":" + std::to_string(r.sin_cambios) +
+                               ",\"lotes_fallidos\":" + std::to_string(r.lotes_fallidos) + "}";
+            if (r.lotes_fallidos > 0) json += ",\"codigo_error\":500";
+            json += confirmar_escritura() + "}";
+            return json;
+        }
+        
+        // Actualizar cliente con concurrencia optimista: el cuerpo trae la "version" que se leyó.
+        // Si otro la modificó entretanto se responde 409 con la versión vigente, sin pisar nada.
+        // estado_http recibe el código HTTP sugerido (200, 400, 404, 409 o 500).
+        std::string actualizar(int id, const std::string& cliente_json, int& estado_http) {
+            Cliente cliente;
+            try {
+                auto datos = nlohmann::json::parse(cliente_json);
+                if (!datos.is_object() || !datos.contains("version") || !datos["version"].is_number_integer()) {
+                    estado_http = 400;
+                    return "{\"exito\":false,\"mensaje\":\"Se requiere la version del cliente leido\",\"codigo_error\":400}";
+                }
+                cliente = leer_cliente(datos);
+                cliente.version = datos["version"].get<int>();
+            } catch (const std::exception&) {
+                estado_http = 400;
+                return "{\"exito\":false,\"mensaje\":\"JSON invalido\",\"codigo_error\":400}";
+            }
+            cliente.id = id;
+            
+            if (cliente.codigo.empty() || cliente.razon_social.empty()) {
+                estado_http = 400;
+                return "{\"exito\":false,\"mensaje\":\"Código y razón social son requeridos\",\"codigo_error\":400}";
+            }
+            
+            switch (dao.actualizar(cliente)) {
+                case ResultadoActualizacion::Actualizado:
+                    estado_http = 200;
+                    return "{\"exito\":true,\"mensaje\":\"Cliente actualizado exitosamente\",\"version\":" +
+                           std::to_string(cliente.version) + confirmar_escritura() + "}";
+                case ResultadoActualizacion::Conflicto:
+                    estado_http = 409;
+                    return "{\"exito\":false,\"mensaje\":\"El cliente fue modificado por otro usuario\",\"codigo_error\":409"
+                           ",\"version_actual\":" + std::to_string(cliente.version) + "}";
+                case ResultadoActualizacion::NoEncontrado:
+                    estado_http = 404;
+                    return "{\"exito\":false,\"mensaje\":\"Cliente no encontrado\",\"codigo_error\":404}";
+                default:
+                    estado_http = 500;
+                    return "{\"exito\":false,\"mensaje\":\"Error al actualizar cliente\",\"codigo_error\":500}";
+            }
+        }
+        
         // Eliminar cliente
         std::string eliminar(int id) {
             if (dao.eliminar(id)) {
-                return "{\"exito\":true,\"mensaje\":\"Cliente eliminado exitosamente\"}";
+                return "{\"exito\":true,\"mensaje\":\"Cliente eliminado exitosamente\"" + confirmar_escritura() + "}";
             } else {
                 return "{\"exito\":false,\"mensaje\":\"Error al eliminar cliente\",\"codigo_error\":500}";
             }
         }
         
     private:
+        // Campo "token" para que el cliente lea su propia escritura (se reenvía como ?token=)
+        // Tras una escritura: invalidar el listado cacheado y devolver el token para la respuesta
+        std::string confirmar_escritura() {
+            std::string token = dao.token_consistencia();
+            listado.invalidar(token);
+            return token.empty() ? "" : ",\"token\":\"" + token + "\"";
+        }
+        
+        // Con el token de la última escritura la reconstrucción la ve aunque lea de una réplica
+        CacheListado::Cuerpo listado_completo(unsigned campos) {
+            return listado.obtener(campos, [&](std::string& json, const std::string& token) {
+                json = "{\"exito\":true,\"mensaje\":\"Clientes obtenidos exitosamente\",\"datos\":[";
+                bool primero = true;
+                bool ok = dao.recorrer_vistas(0, nullptr, [&](const VistaCliente& fila) {
+                    if (!primero) json += ",";
+                    fila.agregar_json(json, campos);
+                    primero = false;
+                    return true;
+                }, nullptr, token, campos);
+                json += "]}";
+                return ok;
+            });
+        }
+        
+        // Validar los filtros del listado; devuelve el JSON de error o vacío si son válidos
+        std::string parse_filtro(const ParametrosListado& p, FiltroClientes& filtro) {
+            if (p.activo.empty() || p.activo == "true") filtro.activo = FiltroClientes::Activo::Si;
+            else if (p.activo == "false") filtro.activo = FiltroClientes::Activo::No;
+            else if (p.activo == "todos") filtro.activo = FiltroClientes::Activo::Todos;
+            else return "{\"exito\":false,\"mensaje\":\"activo debe ser true, false o todos\",\"codigo_error\":400}";
+            
+            if (p.ruc.size() > 11) {
+                return "{\"exito\":false,\"mensaje\":\"ruc invalido\",\"codigo_error\":400}";
+            }
+            if (!p.updated_after.empty() && !es_fecha_hora(p.updated_after)) {
+                return "{\"exito\":false,\"mensaje\":\"updated_after debe ser AAAA-MM-DD o AAAA-MM-DDTHH:MM[:SS]\",\"codigo_error\":400}";
+            }
+            filtro.ruc = p.ruc;
+            filtro.codigo_prefijo = p.codigo_prefix;
+            filtro.actualizado_despues = p.updated_after;
+            return "";
+        }
+        
+        // AAAA-MM-DD, opcionalmente seguido de T o espacio y HH:MM[:SS[.ffffff]], con mes, día
+        // (según el mes y los bisiestos) y hora en rango: lo que pase de aquí no puede fallar en
+        // el ::timestamp de PostgreSQL con un 500
+        static bool es_fecha_hora(const std::string& texto) {
+            const std::string patron = "dddd-dd-dd?dd:dd:dd";
+            if (texto.size() != 10 && texto.size() != 16 && texto.size() < 19) return false;
+            if (texto.size() == patron.size() + 1) return false;  // punto sin dígitos detrás
+            for (size_t i = 0; i < texto.size(); i++) {
+                char c = texto[i];
+                if (i >= patron.size()) {
+                    if (i == patron.size() ? c != '.' : !isdigit((unsigned char)c)) return false;
+                    continue;
+                }
+                char esperado = patron[i];
+                if (esperado == 'd' && !isdigit((unsigned char)c)) return false;
+                if (esperado == '?' && c != 'T' && c != ' ') return false;
+                if (esperado != 'd' && esperado != '?' && c != esperado) return false;
+            }
+            
+            auto numero = [&](size_t pos, size_t largo) { return std::stoi(texto.substr(pos, largo)); };
+            int anio = numero(0, 4), mes = numero(5, 2), dia = numero(8, 2);
+            static const int dias_mes[] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+            bool bisiesto = (anio % 4 == 0 && anio % 100 != 0) || anio % 400 == 0;
+            if (anio < 1 || mes < 1 || mes > 12) return false;
+            if (dia < 1 || dia > dias_mes[mes - 1] + (mes == 2 && bisiesto ? 1 : 0)) return false;
+            if (texto.size() > 10 && (numero(11, 2) > 23 || numero(14, 2) > 59)) return false;
+            if (texto.size() > 16 && numero(17, 2) > 59) return false;
+            return true;
+        }
+        
+        // Validar limit/after; devuelve el JSON de error o vacío si son válidos
+        std::string parse_paginacion(const std::string& limit, const std::string& after,
+                                     int& limite, CursorCliente& cursor) {
+            limite = 100;
+            if (!limit.empty()) {
+                try {
+                    limite = std::stoi(limit);
+                } catch (...) {
+                    limite = 0;
+                }
+                if (limite < 1 || limite > 1000) {
+                    return "{\"exito\":false,\"mensaje\":\"limit debe estar entre 1 y 1000\",\"codigo_error\":400}";
+                }
+            }
+            
+            if (!after.empty() && !CursorCliente::decodificar(after, cursor)) {
+                return "{\"exito\":false,\"mensaje\":\"Cursor invalido\",\"codigo_error\":400}";
+            }
+            return "";
+        }
+        
+        // Campos editables de un cliente desde un objeto JSON ya parseado
+        static Cliente leer_cliente(const nlohmann::json& d) {
+            Cliente c;
+            c.codigo = d.value("codigo", "");
+            c.razon_social = d.value("razon_social", "");
+            c.ruc = d.value("ruc", "");
+            c.direccion = d.value("direccion", "");
+            c.telefono = d.value("telefono", "");
+            c.email = d.value("email", "");
+            return c;
+        }
+        
         Cliente parse_json(const std::string& json) {
             Cliente cliente;
             // Implementación básica - mejorar después
@@ -0,0 +1,114 @@
+#ifndef CONTADOR_CLIENTES_H
+#define CONTADOR_CLIENTES_H
+
+#include "cliente.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+namespace ERP {
+    
+    // Cantidad de clientes activos para GET /api/clientes/count sin tocar la base en la petición.
+    // Un hilo propio refresca la estimación del planificador y el conteo exacto cada 'intervalo',
+    // o antes si llega un cambio (invalidar()), esperando 'espaciado' para juntar ráfagas.
+    class ContadorClientes {
+    public:
+        struct Lectura {
+            long long estimado = -1;  // -1 hasta el primer refresco
+            long long exacto = -1;
+            long long antiguedad_ms = -1; // Edad del conteo exacto
+            bool vigente = false;     // Sin cambios conocidos desde el último conteo exacto
+        };
+        
+    private:
+        AlmacenClientes& dao;
+        std::chrono::milliseconds intervalo;
+        std::chrono::milliseconds espaciado;
+        
+        std::atomic<long long> estimado{-1};
+        std::atomic<long long> exacto{-1};
+        std::atomic<long long> contado_en_ms{0}; // steady_clock del último conteo exacto
+        std::atomic<bool> sucio{true};
+        
+        std::mutex mtx;
+        std::condition_variable despertar;
+        bool detenido = false;
+        std::thread hilo;
+        
+        static long long ahora_ms() {
+            return std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+        }
+        
+    public:
+        ContadorClientes(AlmacenClientes& cliente_dao,
+                         std::chrono::milliseconds intervalo_ = std::chrono::seconds(60),
+                         std::chrono::milliseconds espaciado_ = std::chrono::seconds(2))
+            : dao(cliente_dao), intervalo(intervalo_), espaciado(espaciado_) {
+            hilo = std::thread(&ContadorClientes::bucle, this);
+        }
+        
+        ~ContadorClientes() {
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+                detenido = true;
+            }
+            despertar.notify_one();
+            if (hilo.joinable()) hilo.join();
+        }
+        
+        ContadorClientes(const ContadorClientes&) = delete;
+        ContadorClientes& operator=(const ContadorClientes&) = delete;
+        
+        // Llamar desde el suscriptor de cambios de la tabla clientes
+        void invalidar() {
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+                sucio = true;
+            }
+            despertar.notify_one();
+        }
+        
+        // Solo lee atómicos: nunca bloquea ni consulta la base
+        Lectura leer() const {
+            Lectura l;
+            l.estimado = estimado;
+            l.exacto = exacto;
+            if (l.exacto >= 0) l.antiguedad_ms = ahora_ms() - contado_en_ms;
+            l.vigente = l.exacto >= 0 && !sucio;
+            return l;
+        }
+        
+    private:
+        void bucle() {
+            std::unique_lock<std::mutex> lock(mtx);
+            while (!detenido) {
+                lock.unlock();
+                refrescar();
+                lock.lock();
+                
+                despertar.wait_for(lock, intervalo, [this] { return detenido || sucio.load(); });
+                // Juntar la ráfaga de cambios en un solo conteo
+                if (!detenido && sucio) despertar.wait_for(lock, espaciado, [this] { return detenido; });
+            }
+        }
+        
+        void refrescar() {
+            sucio = false;
+            long long e = dao.estimar_activos();
+            if (e >= 0) estimado = e;
+            long long total = dao.contar_activos();
+            if (total >= 0) {
+                exacto = total;
+                contado_en_ms = ahora_ms();
+            } else {
+                sucio = true; // Reintentar tras 'espaciado'
+            }
+        }
+    };
+    
+} // namespace ERP
+
+#endif
@@ -0,0 +1,107 @@
+#ifndef CORTOCIRCUITO_H
+#define CORTOCIRCUITO_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <random>
+
+namespace ERP {
+    
+    // Circuit breaker de una conexión a PostgreSQL.
+    //  - Cerrado: todo pasa.
+    //  - Abierto: la base no responde; permitir() devuelve false sin tocar la red hasta que
+    //    vence la espera (backoff exponencial con jitter), y entonces deja pasar una sola
+    //    petición que intenta reconectar.
+    //  - Recuperando: reconectó; el tráfico admitido sube linealmente durante la rampa para
+    //    no golpear a un servidor recién levantado con todo el backlog de una vez.
+    class Cortocircuito {
+    public:
+        enum class Estado { Cerrado, Abierto, Recuperando };
+        using Reloj = std::chrono::steady_clock;
+        
+    private:
+        std::atomic<Estado> estado{Estado::Cerrado};
+        std::mutex mtx;
+        Reloj::time_point proxima_prueba;
+        Reloj::time_point inicio_rampa;
+        std::chrono::milliseconds espera;
+        bool probando = false;
+        unsigned contador = 0;
+        std::mt19937 aleatorio{std::random_device{}()};
+        
+        const std::chrono::milliseconds espera_inicial;
+        const std::chrono::milliseconds espera_maxima;
+        const std::chrono::milliseconds rampa;
+        
+    public:
+        Cortocircuito(std::chrono::milliseconds espera_inicial_ = std::chrono::milliseconds(100),
+                      std::chrono::milliseconds espera_maxima_ = std::chrono::seconds(30),
+                      std::chrono::milliseconds rampa_ = std::chrono::seconds(10))
+            : espera(espera_inicial_), espera_inicial(espera_inicial_),
+              espera_maxima(espera_maxima_), rampa(rampa_) {}
+        
+        Estado estado_actual() const {
+            return estado;
+        }
+        
+        // ¿Se puede usar la conexión ahora? En estado cerrado no toma el mutex.
+        bool permitir() {
+            if (estado == Estado::Cerrado) return true;
+            
+            std::lock_guard<std::mutex> lock(mtx);
+            auto ahora = Reloj::now();
+            if (estado == Estado::Abierto) {
+                if (probando || ahora < proxima_prueba) return false;
+                probando = true;
+                return true;
+            }
+            
+            // Recuperando: admitir un porcentaje proporcional al tiempo transcurrido de la rampa
+            auto transcurrido = ahora - inicio_rampa;
+            if (transcurrido >= rampa) {
+                cerrar();
+                return true;
+            }
+            unsigned porcentaje = 1 + (unsigned)(99 * transcurrido / rampa);
+            return contador++ % 100 < porcentaje;
+        }
+        
+        // La conexión respondió (o se reconectó con PQreset)
+        void exito() {
+            if (estado == Estado::Cerrado) return;
+            
+            std::lock_guard<std::mutex> lock(mtx);
+            if (estado == Estado::Abierto && probando) {
+                probando = false;
+                inicio_rampa = Reloj::now();
+                contador = 0;
+                estado = Estado::Recuperando;
+            }
+        }
+        
+        // La conexión se perdió o no se pudo restablecer: abrir y duplicar la espera
+        void fallo() {
+            std::lock_guard<std::mutex> lock(mtx);
+            if (estado == Estado::Abierto && !probando) return; // Ya lo abrió otro hilo
+            espera = estado == Estado::Cerrado ? espera_inicial : std::min(espera * 2, espera_maxima);
+            probando = false;
+            
+            // Jitter de ±20% para que varias instancias no reintenten al mismo tiempo
+            std::uniform_real_distribution<double> jitter(0.8, 1.2);
+            auto retardo = std::chrono::duration_cast<Reloj::duration>(espera * jitter(aleatorio));
+            proxima_prueba = Reloj::now() + retardo;
+            estado = Estado::Abierto;
+        }
+        
+    private:
+        void cerrar() {
+            espera = espera_inicial;
+            estado = Estado::Cerrado;
+        }
+    };
+    
+} // namespace ERP
+
+#endif
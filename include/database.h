@@ -2,36 +2,307 @@
 #define DATABASE_H
 
 #include <libpq-fe.h>
+#include "cortocircuito.h"
 #include <iostream>
 #include <string>
 #include <vector>
 #include <memory>
+#include <functional>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <thread>
+#include <chrono>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#else
+#include <sys/select.h>
+#endif
 
 namespace ERP {
     
+    // Destino de una sentencia: escrituras siempre al primario, lecturas a una réplica
+    enum class Destino { Primario, Replica };
+    
+    // PGresult con dueño compartido: se libera (PQclear) cuando suelta la última referencia,
+    // así una vista de fila puede sobrevivir al callback que la recibió
+    using ResultadoCompartido = std::shared_ptr<PGresult>;
+    
+    inline ResultadoCompartido compartir(PGresult* res) {
+        return ResultadoCompartido(res, PQclear);
+    }
+    
+    // Canal donde los triggers publican "tabla:id" en cada INSERT/UPDATE/DELETE
+    const char* const CANAL_CAMBIOS = "erp_cambios";
+    
+    // Recibe la tabla y el id modificado; id == 0 significa "invalidar toda la tabla"
+    // (p. ej. tras reconectar, porque pudieron perderse notificaciones). 'token' es el de
+    // consistencia tomado al recibir el lote de notificaciones (vacío sin réplicas): cubre
+    // el cambio notificado.
+    using SuscriptorCambios = std::function<void(const std::string& tabla, int id, const std::string& token)>;
+    
+    // Plazo de la petición HTTP que atiende el hilo actual. Mientras el objeto vive, las sentencias
+    // que ejecute Database desde este hilo llevan statement_timeout con el tiempo restante y se
+    // cancelan con PQcancel si el plazo vence o el cliente cierra el socket a mitad de la query.
+    class PlazoPeticion {
+    private:
+        std::chrono::steady_clock::time_point limite;
+        std::function<bool()> cliente_desconectado;
+        PlazoPeticion* anterior;
+        
+        static PlazoPeticion*& vigente() {
+            thread_local PlazoPeticion* plazo = nullptr;
+            return plazo;
+        }
+        
+    public:
+        PlazoPeticion(std::chrono::milliseconds duracion, std::function<bool()> desconectado = nullptr)
+            : limite(std::chrono::steady_clock::now() + duracion),
+              cliente_desconectado(std::move(desconectado)),
+              anterior(vigente()) {
+            vigente() = this;
+        }
+        
+        ~PlazoPeticion() {
+            vigente() = anterior;
+        }
+        
+        PlazoPeticion(const PlazoPeticion&) = delete;
+        PlazoPeticion& operator=(const PlazoPeticion&) = delete;
+        
+        static PlazoPeticion* actual() {
+            return vigente();
+        }
+        
+        long long restante_ms() const {
+            auto restante = std::chrono::duration_cast<std::chrono::milliseconds>(limite - std::chrono::steady_clock::now());
+            return restante.count() > 0 ? restante.count() : 0;
+        }
+        
+        // Vencida o sin nadie esperando la respuesta
+        bool abandonada() const {
+            return std::chrono::steady_clock::now() >= limite || (cliente_desconectado && cliente_desconectado());
+        }
+    };
+    
+    class Transaccion;
+    
     class Database {
+        friend class Transaccion;
+        
     private:
-        PGconn* connection;
+        struct Conexion {
+            PGconn* conn = nullptr;
+            std::string conninfo;
+            std::mutex mtx;
+            std::atomic<uint64_t> lsn_replicado{0}; // Último LSN aplicado conocido (solo réplicas)
+            long long statement_timeout_ms = 0;     // Valor aplicado en la sesión (0 = sin límite, -1 = desconocido)
+            Cortocircuito circuito;                 // Falla rápido mientras la conexión está caída
+        };
+        
+        // Tope de cada intento de reconexión (el circuito espacia los siguientes)
+        static constexpr std::chrono::seconds PLAZO_RECONEXION{5};
+        
+        std::unique_ptr<Conexion> primario;
+        std::vector<std::unique_ptr<Conexion>> replicas;
+        std::atomic<unsigned> siguiente_replica{0};
+        
+        // Conexión dedicada a LISTEN; sus notificaciones se despachan desde un hilo propio
+        PGconn* conn_notificaciones = nullptr;
+        std::thread hilo_notificaciones;
+        std::atomic<bool> escuchando{false};
+        std::mutex mtx_suscriptores;
+        std::vector<SuscriptorCambios> suscriptores;
+        
+        // Transacción que el hilo tiene abierta sobre el primario (ver Transaccion). Mientras
+        // exista, el hilo retiene el mutex del primario y sus sentencias se unen a ella.
+        struct TransaccionHilo {
+            Database* db = nullptr;
+            int profundidad = 0; // Savepoints anidados abiertos
+            std::unique_lock<std::mutex> lock;
+        };
+        
+        static TransaccionHilo& transaccion_hilo() {
+            thread_local TransaccionHilo tx;
+            return tx;
+        }
+        
+        // Lock de la conexión, salvo el primario dentro de una transacción del propio hilo
+        std::unique_lock<std::mutex> bloquear(Conexion& c) {
+            if (&c == primario.get() && en_transaccion()) return std::unique_lock<std::mutex>();
+            return std::unique_lock<std::mutex>(c.mtx);
+        }
+        
+        // Elegir conexión: réplicas en round-robin; con token, solo una réplica que ya haya
+        // aplicado ese LSN (lectura de las propias escrituras). Si ninguna alcanza, el primario.
+        // Dentro de una transacción del hilo todo va al primario: una réplica no ve sus escrituras
+        // sin confirmar. Las conexiones con el circuito abierto se saltan; nullptr si tampoco
+        // queda el primario.
+        Conexion* elegir(Destino destino, const std::string& token = "") {
+            if (destino == Destino::Replica && !replicas.empty() && !en_transaccion()) {
+                uint64_t minimo = token.empty() ? 0 : parse_lsn(token);
+                unsigned inicio = siguiente_replica++;
+                for (size_t i = 0; i < replicas.size(); i++) {
+                    Conexion& r = *replicas[(inicio + i) % replicas.size()];
+                    if (!r.circuito.permitir()) continue;
+                    if (minimo == 0 || r.lsn_replicado >= minimo) return &r;
+                    
+                    std::lock_guard<std::mutex> lock(r.mtx);
+                    if (!conexion_lista(r)) continue;
+                    PGresult* res = PQexec(r.conn, "SELECT pg_last_wal_replay_lsn()::text");
+                    if (PQresultStatus(res) == PGRES_TUPLES_OK && !PQgetisnull(res, 0, 0)) {
+                        r.lsn_replicado = parse_lsn(PQgetvalue(res, 0, 0));
+                    }
+                    PQclear(res);
+                    registrar_salud(r);
+                    if (r.lsn_replicado >= minimo) return &r;
+                }
+            }
+            if (en_transaccion()) return primario.get();
+            return primario->circuito.permitir() ? primario.get() : nullptr;
+        }
+        
+        // Con el lock de la conexión tomado: si se cayó, intentar reconectar. Solo llega aquí una
+        // petición por ventana de backoff (el circuito deja pasar una prueba a la vez).
+        bool conexion_lista(Conexion& c) {
+            if (PQstatus(c.conn) == CONNECTION_OK) {
+                c.circuito.exito();
+                return true;
+            }
+            auto limite = std::chrono::steady_clock::now() + PLAZO_RECONEXION;
+            if (PlazoPeticion* plazo = PlazoPeticion::actual()) {
+                limite = std::min(limite, std::chrono::steady_clock::now() + std::chrono::milliseconds(plazo->restante_ms()));
+            }
+            if (!reconectar(c.conn, limite)) {
+                std::cerr << "Reconexión fallida: " << PQerrorMessage(c.conn) << std::endl;
+                c.circuito.fallo();
+                return false;
+            }
+            std::cout << "✅ Reconectado a PostgreSQL" << std::endl;
+            c.statement_timeout_ms = 0; // Sesión nueva: valores por defecto
+            c.circuito.exito();
+            return true;
+        }
+        
+        // PQreset no bloqueante acotado por 'limite'. PQreset bloquea hasta el timeout TCP del
+        // sistema si el host no responde, y aquí se llama con el mutex de la conexión tomado.
+        static bool reconectar(PGconn* conn, std::chrono::steady_clock::time_point limite) {
+            if (!PQresetStart(conn)) return false;
+            PostgresPollingStatusType estado = PGRES_POLLING_WRITING;
+            while (estado != PGRES_POLLING_OK) {
+                if (estado == PGRES_POLLING_FAILED) return false;
+                auto restante = std::chrono::duration_cast<std::chrono::microseconds>(limite - std::chrono::steady_clock::now());
+                if (restante.count() <= 0) {
+                    std::cerr << "Reconexión abandonada: plazo vencido" << std::endl;
+                    return false;
+                }
+                int sock = PQsocket(conn);
+                fd_set fds;
+                FD_ZERO(&fds);
+                FD_SET(sock, &fds);
+                timeval timeout;
+                timeout.tv_sec = (long)(restante.count() / 1000000);
+                timeout.tv_usec = (long)(restante.count() % 1000000);
+                bool leer = estado == PGRES_POLLING_READING;
+                if (select(sock + 1, leer ? &fds : nullptr, leer ? nullptr : &fds, nullptr, &timeout) > 0) {
+                    estado = PQresetPoll(conn);
+                }
+            }
+            return PQstatus(conn) == CONNECTION_OK;
+        }
+        
+        // Tras usar la conexión: una conexión rota abre el circuito; errores de SQL no cuentan
+        void registrar_salud(Conexion& c) {
+            if (PQstatus(c.conn) == CONNECTION_BAD) {
+                if (c.circuito.estado_actual() != Cortocircuito::Estado::Abierto) {
+                    std::cerr << "Conexión a PostgreSQL perdida: se rechazan peticiones hasta reconectar" << std::endl;
+                }
+                c.circuito.fallo();
+            } else {
+                c.circuito.exito();
+            }
+        }
+        
+        static std::unique_ptr<Conexion> conectar(const std::string& conninfo) {
+            auto c = std::make_unique<Conexion>();
+            c->conninfo = conninfo;
+            c->conn = PQconnectdb(conninfo.c_str());
+            if (PQstatus(c->conn) != CONNECTION_OK) {
+                std::cerr << "Error de conexión: " << PQerrorMessage(c->conn) << std::endl;
+                PQfinish(c->conn);
+                return nullptr;
+            }
+            return c;
+        }
         
     public:
-        Database(const std::string& conninfo) {
-            connection = PQconnectdb(conninfo.c_str());
-            if (PQstatus(connection) != CONNECTION_OK) {
-                std::cerr << "Error de conexión: " << PQerrorMessage(connection) << std::endl;
+        // "16/B374D848" -> 0x16B374D848
+        static uint64_t parse_lsn(const std::string& lsn) {
+            size_t slash = lsn.find('/');
+            if (slash == std::string::npos) return 0;
+            uint64_t alto = std::strtoull(lsn.substr(0, slash).c_str(), nullptr, 16);
+            uint64_t bajo = std::strtoull(lsn.substr(slash + 1).c_str(), nullptr, 16);
+            return (alto << 32) | bajo;
+        }
+        
+        Database(const std::string& conninfo) : Database(conninfo, {}) {}
+        
+        // Primario para escrituras y cero o más réplicas (streaming replication) para lecturas
+        Database(const std::string& conninfo_primario, const std::vector<std::string>& conninfo_replicas) {
+            primario = conectar(conninfo_primario);
+            if (!primario) {
                 throw std::runtime_error("No se pudo conectar a PostgreSQL");
             }
             std::cout << "✅ Conectado a PostgreSQL" << std::endl;
+            
+            for (const auto& info : conninfo_replicas) {
+                auto replica = conectar(info);
+                if (!replica) {
+                    std::cerr << "Réplica no disponible, se omite: " << info << std::endl;
+                    continue;
+                }
+                replicas.push_back(std::move(replica));
+            }
+            if (!replicas.empty()) {
+                std::cout << "✅ Conectado a " << replicas.size() << " réplica(s) de lectura" << std::endl;
+            }
         }
         
         ~Database() {
-            if (connection) PQfinish(connection);
+            detener_notificaciones();
+            if (primario && primario->conn) PQfinish(primario->conn);
+            for (auto& r : replicas) PQfinish(r->conn);
         }
         
         // Ejecutar query sin retorno
         bool execute(const std::string& query) {
-            PGresult* res = PQexec(connection, query.c_str());
+            Conexion* conexion = elegir(Destino::Primario);
+            if (!conexion) return false;
+            Conexion& c = *conexion;
+            std::unique_lock<std::mutex> lock = bloquear(c);
+            if (!conexion_lista(c)) return false;
+            PGresult* res = ejecutar(c, query, nullptr);
             if (PQresultStatus(res) != PGRES_COMMAND_OK) {
-                std::cerr << "Error ejecutando query: " << PQerrorMessage(connection) << std::endl;
+                std::cerr << "Error ejecutando query: " << PQerrorMessage(c.conn) << std::endl;
+                PQclear(res);
+                return false;
+            }
+            PQclear(res);
+            return true;
+        }
+        
+        // Ejecutar sentencia parametrizada sin retorno ($1, $2, ... en formato texto)
+        bool execute(const std::string& query, const std::vector<std::string>& params) {
+            Conexion* conexion = elegir(Destino::Primario);
+            if (!conexion) return false;
+            Conexion& c = *conexion;
+            std::unique_lock<std::mutex> lock = bloquear(c);
+            if (!conexion_lista(c)) return false;
+            PGresult* res = ejecutar(c, query, &params);
+            if (PQresultStatus(res) != PGRES_COMMAND_OK) {
+                std::cerr << "Error ejecutando query: " << PQerrorMessage(c.conn) << std::endl;
                 PQclear(res);
                 return false;
             }
@@ -40,38 +311,433 @@ namespace ERP {
         }
         
         // Ejecutar query con retorno
-        PGresult* query(const std::string& query) {
-            PGresult* res = PQexec(connection, query.c_str());
+        PGresult* query(const std::string& query, Destino destino = Destino::Primario, const std::string& token = "") {
+            Conexion* conexion = elegir(destino, token);
+            if (!conexion) return nullptr;
+            Conexion& c = *conexion;
+            std::unique_lock<std::mutex> lock = bloquear(c);
+            if (!conexion_lista(c)) return nullptr;
+            PGresult* res = ejecutar(c, query, nullptr);
             if (PQresultStatus(res) != PGRES_TUPLES_OK) {
-                std::cerr << "Error en query: " << PQerrorMessage(connection) << std::endl;
+                std::cerr << "Error en query: " << PQerrorMessage(c.conn) << std::endl;
                 PQclear(res);
                 return nullptr;
             }
             return res;
         }
         
-        // Inicializar tablas
-        bool initialize_tables() {
-            std::string create_table = R"(
-                CREATE TABLE IF NOT EXISTS clientes (
-                    id SERIAL PRIMARY KEY,
-                    codigo VARCHAR(20) UNIQUE NOT NULL,
-                    razon_social VARCHAR(200) NOT NULL,
-                    ruc VARCHAR(11) UNIQUE NOT NULL,
-                    direccion TEXT,
-                    telefono VARCHAR(20),
-                    email VARCHAR(100),
-                    activo BOOLEAN DEFAULT true,
-                    fecha_creacion TIMESTAMP DEFAULT CURRENT_TIMESTAMP,
-                    fecha_actualizacion TIMESTAMP DEFAULT CURRENT_TIMESTAMP
-                );
+        // Ejecutar query parametrizada con retorno ($1, $2, ... en formato texto)
+        PGresult* query(const std::string& query, const std::vector<std::string>& params,
+                        Destino destino = Destino::Primario, const std::string& token = "") {
+            Conexion* conexion = elegir(destino, token);
+            if (!conexion) return nullptr;
+            Conexion& c = *conexion;
+            std::unique_lock<std::mutex> lock = bloquear(c);
+            if (!conexion_lista(c)) return nullptr;
+            PGresult* res = ejecutar(c, query, &params);
+            if (PQresultStatus(res) != PGRES_TUPLES_OK) {
+                std::cerr << "Error en query: " << PQerrorMessage(c.conn) << std::endl;
+                PQclear(res);
+                return nullptr;
+            }
+            return res;
+        }
+        
+        // Ejecutar query parametrizada en modo single-row: por_fila recibe cada fila apenas llega
+        // (un PGresult de una sola tupla, liberado al soltar la última referencia). Si por_fila
+        // devuelve false se cancela.
+        bool query_stream(const std::string& query, const std::vector<std::string>& params,
+                          const std::function<bool(const ResultadoCompartido&)>& por_fila,
+                          Destino destino = Destino::Primario, const std::string& token = "") {
+            std::vector<const char*> valores;
+            valores.reserve(params.size());
+            for (const auto& p : params) valores.push_back(p.c_str());
+            
+            Conexion* conexion = elegir(destino, token);
+            if (!conexion) return false;
+            Conexion& c = *conexion;
+            std::unique_lock<std::mutex> lock = bloquear(c);
+            if (!conexion_lista(c) || !aplicar_plazo(c)) return false;
+            if (!PQsendQueryParams(c.conn, query.c_str(), (int)valores.size(),
+                                   nullptr, valores.data(), nullptr, nullptr, 0)) {
+                std::cerr << "Error enviando query: " << PQerrorMessage(c.conn) << std::endl;
+                return false;
+            }
+            if (!PQsetSingleRowMode(c.conn)) {
+                std::cerr << "No se pudo activar el modo single-row" << std::endl;
+            }
+            
+            bool completo = true;
+            bool cancelado = false;
+            PGresult* res;
+            while (esperar(c, cancelado) && (res = PQgetResult(c.conn)) != nullptr) {
+                ExecStatusType estado = PQresultStatus(res);
+                if (estado == PGRES_SINGLE_TUPLE) {
+                    // La fila queda viva mientras el consumidor conserve una referencia
+                    if (!cancelado && !por_fila(compartir(res))) {
+                        cancelado = true;
+                        cancelar_consulta(c.conn);
+                    }
+                    continue;
+                }
+                if (estado != PGRES_TUPLES_OK && !cancelado) {
+                    std::cerr << "Error en query: " << PQerrorMessage(c.conn) << std::endl;
+                    completo = false;
+                }
+                PQclear(res);
+            }
+            registrar_salud(c);
+            return completo && !cancelado;
+        }
+        
+        // Ejecutar COPY ... TO STDOUT y entregar cada bloque al consumidor sin acumularlo.
+        // Si el consumidor devuelve false (p. ej. el cliente HTTP se desconectó) se cancela el COPY.
+        bool copy_out(const std::string& query, const std::function<bool(const char*, size_t)>& consumidor,
+                      Destino destino = Destino::Primario) {
+            Conexion* conexion = elegir(destino);
+            if (!conexion) return false;
+            Conexion& c = *conexion;
+            std::unique_lock<std::mutex> lock = bloquear(c);
+            if (!conexion_lista(c)) return false;
+            PGresult* res = ejecutar(c, query, nullptr);
+            if (PQresultStatus(res) != PGRES_COPY_OUT) {
+                std::cerr << "Error iniciando COPY: " << PQerrorMessage(c.conn) << std::endl;
+                PQclear(res);
+                return false;
+            }
+            PQclear(res);
+            
+            // Con plazo se lee en modo asíncrono para poder vigilarlo entre bloques
+            int asincrono = PlazoPeticion::actual() ? 1 : 0;
+            bool completo = true;
+            bool cancelado = false;
+            char* buffer = nullptr;
+            int len;
+            while ((len = PQgetCopyData(c.conn, &buffer, asincrono)) >= 0) {
+                if (len == 0) {
+                    if (!vigilar(c, cancelado)) break;
+                    continue;
+                }
+                bool seguir = cancelado || consumidor(buffer, static_cast<size_t>(len));
+                PQfreemem(buffer);
+                if (!seguir) {
+                    cancelado = true;
+                    cancelar_consulta(c.conn);
+                }
+            }
+            if (len == -2 && !cancelado) {
+                std::cerr << "Error leyendo COPY: " << PQerrorMessage(c.conn) << std::endl;
+                completo = false;
+            }
+            
+            // Consumir el resultado final para dejar la conexión lista
+            while ((res = PQgetResult(c.conn)) != nullptr) {
+                if (completo && !cancelado && PQresultStatus(res) != PGRES_COMMAND_OK) {
+                    std::cerr << "Error finalizando COPY: " << PQerrorMessage(c.conn) << std::endl;
+                    completo = false;
+                }
+                PQclear(res);
+            }
+            registrar_salud(c);
+            return completo && !cancelado;
+        }
+        
+        // Token de consistencia: posición actual del WAL en el primario. Una lectura con este
+        // token solo se sirve desde una réplica que ya lo haya aplicado.
+        std::string token_consistencia() {
+            if (replicas.empty()) return "";
+            PGresult* res = query("SELECT pg_current_wal_lsn()::text");
+            if (!res) return "";
+            std::string lsn = PQgetvalue(res, 0, 0);
+            PQclear(res);
+            return lsn;
+        }
+        
+        size_t num_replicas() const {
+            return replicas.size();
+        }
+        
+        // ¿El hilo actual tiene una Transaccion abierta en esta base?
+        bool en_transaccion() const {
+            return transaccion_hilo().db == this;
+        }
+        
+        // Abrir la conexión de notificaciones al primario y escuchar el canal de cambios
+        bool iniciar_notificaciones() {
+            if (escuchando) return true;
+            conn_notificaciones = PQconnectdb(primario->conninfo.c_str());
+            if (PQstatus(conn_notificaciones) != CONNECTION_OK || !escuchar()) {
+                std::cerr << "Error iniciando notificaciones: " << PQerrorMessage(conn_notificaciones) << std::endl;
+                PQfinish(conn_notificaciones);
+                conn_notificaciones = nullptr;
+                return false;
+            }
+            
+            escuchando = true;
+            hilo_notificaciones = std::thread(&Database::bucle_notificaciones, this);
+            return true;
+        }
+        
+        void detener_notificaciones() {
+            escuchando = false;
+            if (hilo_notificaciones.joinable()) hilo_notificaciones.join();
+            if (conn_notificaciones) {
+                PQfinish(conn_notificaciones);
+                conn_notificaciones = nullptr;
+            }
+        }
+        
+        // Registrar un callback de invalidación; se invoca desde el hilo de notificaciones
+        void suscribir(SuscriptorCambios suscriptor) {
+            std::lock_guard<std::mutex> lock(mtx_suscriptores);
+            suscriptores.push_back(std::move(suscriptor));
+        }
+        
+    private:
+        // BEGIN (o SAVEPOINT si el hilo ya tiene una transacción abierta en esta base)
+        bool abrir_transaccion(std::string& savepoint) {
+            TransaccionHilo& tx = transaccion_hilo();
+            if (tx.db == this) {
+                savepoint = "sp_" + std::to_string(++tx.profundidad);
+                if (comando_transaccion("SAVEPOINT " + savepoint)) return true;
+                tx.profundidad--;
+                return false;
+            }
+            if (tx.db) {
+                std::cerr << "No se puede abrir una transacción sobre dos bases a la vez" << std::endl;
+                return false;
+            }
+            
+            Conexion* c = elegir(Destino::Primario);
+            if (!c) return false;
+            std::unique_lock<std::mutex> lock(c->mtx);
+            if (!conexion_lista(*c)) return false;
+            tx.db = this;
+            tx.profundidad = 0;
+            tx.lock = std::move(lock);
+            if (comando_transaccion("BEGIN")) return true;
+            tx.db = nullptr;
+            tx.lock = std::unique_lock<std::mutex>();
+            return false;
+        }
+        
+        // COMMIT/ROLLBACK, o RELEASE/ROLLBACK TO del savepoint. Un COMMIT sobre una transacción
+        // abortada responde "ROLLBACK": se informa como fallo.
+        bool cerrar_transaccion(const std::string& savepoint, bool confirmar) {
+            TransaccionHilo& tx = transaccion_hilo();
+            if (tx.db != this) return false;
+            
+            if (!savepoint.empty()) {
+                bool ok = confirmar ? comando_transaccion("RELEASE SAVEPOINT " + savepoint)
+                                    : comando_transaccion("ROLLBACK TO SAVEPOINT " + savepoint) &&
+                                      comando_transaccion("RELEASE SAVEPOINT " + savepoint);
+                tx.profundidad--;
+                return ok;
+            }
+            
+            bool ok = comando_transaccion(confirmar ? "COMMIT" : "ROLLBACK");
+            tx.db = nullptr;
+            tx.profundidad = 0;
+            tx.lock = std::unique_lock<std::mutex>();
+            return ok;
+        }
+        
+        // Sin plazo: un ROLLBACK tiene que salir aunque la petición ya haya vencido
+        bool comando_transaccion(const std::string& comando) {
+            Conexion& c = *primario;
+            PGresult* res = PQexec(c.conn, comando.c_str());
+            bool ok = PQresultStatus(res) == PGRES_COMMAND_OK &&
+                      (comando != "COMMIT" || std::string(PQcmdStatus(res)) == "COMMIT");
+            if (!ok) std::cerr << "Error en " << comando << ": " << PQerrorMessage(c.conn) << std::endl;
+            PQclear(res);
+            registrar_salud(c);
+            return ok;
+        }
+        
+        bool escuchar() {
+            std::string listen = std::string("LISTEN ") + CANAL_CAMBIOS;
+            PGresult* res = PQexec(conn_notificaciones, listen.c_str());
+            bool ok = PQresultStatus(res) == PGRES_COMMAND_OK;
+            PQclear(res);
+            return ok;
+        }
+        
+        void notificar(const std::string& tabla, int id, const std::string& token) {
+            std::lock_guard<std::mutex> lock(mtx_suscriptores);
+            for (const auto& suscriptor : suscriptores) {
+                suscriptor(tabla, id, token);
+            }
+        }
+        
+        // Esperar en el socket de la conexión dedicada (con timeout para poder detenerse)
+        // y despachar cada NOTIFY "tabla:id" a los suscriptores. El token se pide una vez por
+        // lote leído, no por notificación: un sincronizar de 10k filas son 10k NOTIFY.
+        void bucle_notificaciones() {
+            std::chrono::milliseconds espera(250);
+            while (escuchando) {
+                if (PQstatus(conn_notificaciones) != CONNECTION_OK) {
+                    // Backoff exponencial hasta 30 s, en pasos cortos para poder detenerse
+                    for (auto t = std::chrono::milliseconds(0); t < espera && escuchando; t += std::chrono::milliseconds(250)) {
+                        std::this_thread::sleep_for(std::chrono::milliseconds(250));
+                    }
+                    if (!escuchando) break;
+                    if (reconectar(conn_notificaciones, std::chrono::steady_clock::now() + PLAZO_RECONEXION) && escuchar()) {
+                        std::cout << "Notificaciones reconectadas" << std::endl;
+                        notificar("clientes", 0, token_consistencia());
+                        espera = std::chrono::milliseconds(250);
+                    } else {
+                        espera = std::min(espera * 2, std::chrono::milliseconds(30000));
+                    }
+                    continue;
+                }
+                
+                int sock = PQsocket(conn_notificaciones);
+                fd_set readfds;
+                FD_ZERO(&readfds);
+                FD_SET(sock, &readfds);
+                timeval timeout;
+                timeout.tv_sec = 0;
+                timeout.tv_usec = 250000;
+                
+                if (select(sock + 1, &readfds, nullptr, nullptr, &timeout) <= 0) continue;
+                if (!PQconsumeInput(conn_notificaciones)) continue;
                 
-                CREATE INDEX IF NOT EXISTS idx_clientes_codigo ON clientes(codigo);
-                CREATE INDEX IF NOT EXISTS idx_clientes_ruc ON clientes(ruc);
-                CREATE INDEX IF NOT EXISTS idx_clientes_activo ON clientes(activo);
-            )";
+                std::vector<std::pair<std::string, int>> cambios;
+                PGnotify* notify;
+                while ((notify = PQnotifies(conn_notificaciones)) != nullptr) {
+                    std::string payload = notify->extra ? notify->extra : "";
+                    PQfreemem(notify);
+                    
+                    size_t sep = payload.rfind(':');
+                    if (sep == std::string::npos) continue;
+                    cambios.emplace_back(payload.substr(0, sep), std::atoi(payload.c_str() + sep + 1));
+                }
+                if (cambios.empty()) continue;
+                std::string token = token_consistencia();
+                for (const auto& cambio : cambios) notificar(cambio.first, cambio.second, token);
+            }
+        }
+        
+        // Ajustar statement_timeout de la sesión al plazo de la petición actual. Se redondea hacia
+        // arriba al segundo para que las sentencias de peticiones con el mismo plazo reutilicen el
+        // valor ya aplicado sin un SET extra; el corte exacto lo hace esperar(). Sin plazo (hilos
+        // de fondo: contador, precarga, notificaciones) se deja el que haya, para no alternar con
+        // un SET en cada sentencia entre esos hilos y las peticiones.
+        // Dentro de una transacción no se toca: un ROLLBACK revertiría el SET y el valor cacheado.
+        bool aplicar_plazo(Conexion& c) {
+            PlazoPeticion* plazo = PlazoPeticion::actual();
+            if (plazo && plazo->abandonada()) {
+                std::cerr << "Petición vencida o abandonada: no se envía la sentencia" << std::endl;
+                return false;
+            }
+            
+            if (!plazo) return true;
+            long long timeout_ms = (plazo->restante_ms() + 999) / 1000 * 1000;
+            if (timeout_ms == c.statement_timeout_ms || PQtransactionStatus(c.conn) != PQTRANS_IDLE) return true;
+            
+            std::string set = "SET statement_timeout = " + std::to_string(timeout_ms);
+            PGresult* res = PQexec(c.conn, set.c_str());
+            bool ok = PQresultStatus(res) == PGRES_COMMAND_OK;
+            PQclear(res);
+            if (!ok) {
+                // La sentencia no puede salir sin su plazo; el valor de la sesión ya no se conoce
+                std::cerr << "No se pudo aplicar statement_timeout: " << PQerrorMessage(c.conn) << std::endl;
+                c.statement_timeout_ms = -1;
+                return false;
+            }
+            c.statement_timeout_ms = timeout_ms;
+            return true;
+        }
+        
+        // Equivalente a PQexec/PQexecParams (devuelve el último resultado, o el primero con error),
+        // pero vigilando el plazo de la petición mientras la sentencia corre
+        PGresult* ejecutar(Conexion& c, const std::string& query, const std::vector<std::string>* params) {
+            if (!aplicar_plazo(c)) return nullptr;
+            
+            std::vector<const char*> valores;
+            if (params) {
+                valores.reserve(params->size());
+                for (const auto& p : *params) valores.push_back(p.c_str());
+            }
             
-            return execute(create_table);
+            if (!PlazoPeticion::actual()) {
+                PGresult* res = params ? PQexecParams(c.conn, query.c_str(), (int)valores.size(),
+                                                      nullptr, valores.data(), nullptr, nullptr, 0)
+                                       : PQexec(c.conn, query.c_str());
+                registrar_salud(c);
+                return res;
+            }
+            
+            // Sin parámetros se admiten varias sentencias separadas por ';', como en PQexec
+            int enviado = params ? PQsendQueryParams(c.conn, query.c_str(), (int)valores.size(),
+                                                     nullptr, valores.data(), nullptr, nullptr, 0)
+                                 : PQsendQuery(c.conn, query.c_str());
+            if (!enviado) {
+                registrar_salud(c);
+                return nullptr;
+            }
+            
+            bool cancelada = false;
+            PGresult* resultado = nullptr;
+            PGresult* res;
+            while (esperar(c, cancelada) && (res = PQgetResult(c.conn)) != nullptr) {
+                ExecStatusType estado = PQresultStatus(res);
+                bool error = estado == PGRES_FATAL_ERROR || estado == PGRES_BAD_RESPONSE;
+                bool con_error = resultado && PQresultStatus(resultado) == PGRES_FATAL_ERROR;
+                if (con_error && !error) {
+                    PQclear(res);
+                    continue;
+                }
+                if (resultado) PQclear(resultado);
+                resultado = res;
+                // COPY queda en curso: el llamador lee los datos y consume el resultado final
+                if (estado == PGRES_COPY_OUT || estado == PGRES_COPY_IN) break;
+            }
+            registrar_salud(c);
+            return resultado;
+        }
+        
+        // Esperar a que PQgetResult no bloquee. Solo con plazo: sin él PQgetResult espera
+        // directamente, como siempre.
+        bool esperar(Conexion& c, bool& cancelada) {
+            if (!PlazoPeticion::actual()) return true;
+            while (PQisBusy(c.conn)) {
+                if (!vigilar(c, cancelada)) return false;
+            }
+            return true;
+        }
+        
+        // Un ciclo de espera en el socket de la conexión; si la petición venció o el cliente
+        // se fue, se cancela la sentencia (una sola vez) y se sigue leyendo hasta el error
+        bool vigilar(Conexion& c, bool& cancelada) {
+            int sock = PQsocket(c.conn);
+            fd_set readfds;
+            FD_ZERO(&readfds);
+            FD_SET(sock, &readfds);
+            timeval timeout;
+            timeout.tv_sec = 0;
+            timeout.tv_usec = 50000;
+            select(sock + 1, &readfds, nullptr, nullptr, &timeout);
+            if (!PQconsumeInput(c.conn)) return false;
+            
+            PlazoPeticion* plazo = PlazoPeticion::actual();
+            if (!cancelada && plazo && plazo->abandonada()) {
+                std::cerr << "Petición vencida o abandonada: cancelando la sentencia" << std::endl;
+                cancelada = true;
+                cancelar_consulta(c.conn);
+            }
+            return true;
+        }
+        
+        // Pedir al servidor que aborte la sentencia en curso
+        static void cancelar_consulta(PGconn* conn) {
+            PGcancel* cancel = PQgetCancel(conn);
+            if (!cancel) return;
+            char errbuf[256];
+            if (!PQcancel(cancel, errbuf, sizeof(errbuf))) {
+                std::cerr << "Error cancelando query: " << errbuf << std::endl;
+            }
+            PQfreeCancel(cancel);
         }
     };
     
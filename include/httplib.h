@@ -29,6 +29,9 @@
 #include <vector>
 #include <sstream>
 #include <iostream>
+#include <cstdio>
+#include <cctype>
+#include <cstdlib>
 
 namespace httplib {
 
@@ -43,6 +46,8 @@ namespace httplib {
         std::string body;
         std::map<std::string, std::string> params;
         std::smatch matches;
+        // true si el cliente cerró la conexión (para abandonar trabajo cuya respuesta nadie leerá)
+        std::function<bool()> is_connection_closed = []() { return false; };
         
         std::string get_param_value(const std::string& key) const {
             auto it = params.find(key);
@@ -55,10 +60,27 @@ namespace httplib {
         }
     };
 
+    // Destino de escritura para respuestas generadas por partes
+    struct DataSink {
+        std::function<bool(const char* data, size_t data_len)> write;
+        std::function<void()> done;
+    };
+    
+    using ContentProviderWithoutLength = std::function<bool(size_t offset, DataSink& sink)>;
+
     struct Response {
         int status = 200;
         std::map<std::string, std::string> headers;
         std::string body;
+        ContentProviderWithoutLength content_provider;
+        
+        // Respuesta con Transfer-Encoding: chunked; el proveedor se invoca hasta que llame a sink.done()
+        void set_chunked_content_provider(const std::string& content_type, ContentProviderWithoutLength provider) {
+            headers["Content-Type"] = content_type;
+            headers["Transfer-Encoding"] = "chunked";
+            headers.erase("Content-Length");
+            content_provider = std::move(provider);
+        }
         
         void set_content(const std::string& content, const std::string& content_type) {
             body = content;
@@ -114,6 +136,22 @@ namespace httplib {
 #endif
         }
         
+        // Decodificar %XX y '+' de la query string
+        static std::string decode_url(const std::string& s) {
+            std::string result;
+            for (size_t i = 0; i < s.size(); i++) {
+                if (s[i] == '+') {
+                    result += ' ';
+                } else if (s[i] == '%' && i + 2 < s.size() && isxdigit((unsigned char)s[i + 1]) && isxdigit((unsigned char)s[i + 2])) {
+                    result += (char)std::stoi(s.substr(i + 1, 2), nullptr, 16);
+                    i += 2;
+                } else {
+                    result += s[i];
+                }
+            }
+            return result;
+        }
+        
         std::map<std::string, std::string> parse_query_string(const std::string& query) {
             std::map<std::string, std::string> params;
             std::istringstream iss(query);
@@ -122,8 +160,8 @@ namespace httplib {
             while (std::getline(iss, pair, '&')) {
                 auto pos = pair.find('=');
                 if (pos != std::string::npos) {
-                    std::string key = pair.substr(0, pos);
-                    std::string value = pair.substr(pos + 1);
+                    std::string key = decode_url(pair.substr(0, pos));
+                    std::string value = decode_url(pair.substr(pos + 1));
                     params[key] = value;
                 }
             }
@@ -174,30 +212,124 @@ namespace httplib {
             return req;
         }
         
+        static const char* status_message(int status) {
+            switch (status) {
+                case 200: return "OK";
+                case 400: return "Bad Request";
+                case 404: return "Not Found";
+                case 409: return "Conflict";
+                case 500: return "Internal Server Error";
+                case 503: return "Service Unavailable";
+                default: return "OK";
+            }
+        }
+        
         std::string generate_response(const Response& res) {
             std::ostringstream oss;
-            oss << "HTTP/1.1 " << res.status << " OK\r\n";
+            oss << "HTTP/1.1 " << res.status << " " << status_message(res.status) << "\r\n";
             
             for (const auto& header : res.headers) {
                 oss << header.first << ": " << header.second << "\r\n";
             }
             
-            oss << "\r\n" << res.body;
+            oss << "\r\n";
+            if (!res.content_provider) oss << res.body;
             return oss.str();
         }
         
-        void handle_client(int client_socket) {
-            char buffer[8192] = {0};
+        bool write_all(int client_socket, const char* data, size_t len) {
+            while (len > 0) {
+#ifdef _WIN32
+                int sent = send(client_socket, data, (int)len, 0);
+#else
+                ssize_t sent = write(client_socket, data, len);
+#endif
+                if (sent <= 0) return false;
+                data += sent;
+                len -= (size_t)sent;
+            }
+            return true;
+        }
+        
+        // Enviar el cuerpo en chunks a medida que el proveedor lo produce
+        void write_chunked_content(int client_socket, const Response& res) {
+            bool ok = true;
+            bool finished = false;
+            size_t offset = 0;
             
+            DataSink sink;
+            sink.write = [&](const char* data, size_t data_len) {
+                if (!ok) return false;
+                if (data_len == 0) return true;
+                char size_line[32];
+                int n = snprintf(size_line, sizeof(size_line), "%zx\r\n", data_len);
+                ok = write_all(client_socket, size_line, (size_t)n) &&
+                     write_all(client_socket, data, data_len) &&
+                     write_all(client_socket, "\r\n", 2);
+                offset += data_len;
+                return ok;
+            };
+            sink.done = [&]() {
+                if (!finished && ok) ok = write_all(client_socket, "0\r\n\r\n", 5);
+                finished = true;
+            };
+            
+            while (ok && !finished) {
+                if (!res.content_provider(offset, sink)) break;
+            }
+        }
+        
+        // Leer headers y el cuerpo completo según Content-Length (hasta 64MB)
+        std::string read_request(int client_socket) {
+            const size_t max_request = 64 * 1024 * 1024;
+            std::string raw_request;
+            char buffer[8192];
+            size_t expected = std::string::npos;
+            
+            while (raw_request.size() < expected && raw_request.size() < max_request) {
 #ifdef _WIN32
-            int bytes_received = recv(client_socket, buffer, sizeof(buffer) - 1, 0);
+                int bytes_received = recv(client_socket, buffer, sizeof(buffer), 0);
 #else
-            ssize_t bytes_received = read(client_socket, buffer, sizeof(buffer) - 1);
+                ssize_t bytes_received = read(client_socket, buffer, sizeof(buffer));
 #endif
+                if (bytes_received <= 0) break;
+                raw_request.append(buffer, (size_t)bytes_received);
+                
+                if (expected == std::string::npos) {
+                    size_t header_end = raw_request.find("\r\n\r\n");
+                    if (header_end == std::string::npos) continue;
+                    size_t content_length = 0;
+                    std::string headers = raw_request.substr(0, header_end);
+                    for (auto& c : headers) c = (char)tolower((unsigned char)c);
+                    size_t pos = headers.find("\r\ncontent-length:");
+                    if (pos != std::string::npos) {
+                        content_length = std::strtoul(headers.c_str() + pos + 17, nullptr, 10);
+                    }
+                    expected = header_end + 4 + content_length;
+                }
+            }
+            return raw_request;
+        }
+        
+        // El cliente cerró si el socket está legible pero no queda nada por leer (EOF o error)
+        static bool is_socket_closed(int client_socket) {
+            fd_set fds;
+            FD_ZERO(&fds);
+            FD_SET(client_socket, &fds);
+            timeval timeout;
+            timeout.tv_sec = 0;
+            timeout.tv_usec = 0;
+            if (select(client_socket + 1, &fds, nullptr, nullptr, &timeout) <= 0) return false;
+            char c;
+            return recv(client_socket, &c, 1, MSG_PEEK) <= 0;
+        }
+        
+        void handle_client(int client_socket) {
+            std::string raw_request = read_request(client_socket);
             
-            if (bytes_received > 0) {
-                std::string raw_request(buffer, bytes_received);
+            if (!raw_request.empty()) {
                 Request req = parse_request(raw_request);
+                req.is_connection_closed = [client_socket]() { return is_socket_closed(client_socket); };
                 Response res;
                 
                 // Pre-routing handler
@@ -235,11 +367,13 @@ namespace httplib {
                 }
                 
                 std::string response = generate_response(res);
+                write_all(client_socket, response.c_str(), response.length());
+                if (res.content_provider) {
+                    write_chunked_content(client_socket, res);
+                }
 #ifdef _WIN32
-                send(client_socket, response.c_str(), (int)response.length(), 0);
                 closesocket(client_socket);
 #else
-                write(client_socket, response.c_str(), response.length());
                 close(client_socket);
 #endif
             }
@@ -315,7 +449,7 @@ namespace httplib {
             }
             
             // Listen for connections
-            if (listen(server_socket_, 10) < 0) {
+            if (::listen(server_socket_, 10) < 0) {
                 std::cerr << "Error listening on socket" << std::endl;
 #ifdef _WIN32
                 closesocket(server_socket_);
@@ -0,0 +1,341 @@
+#ifndef IMAGEN_CLIENTES_H
+#define IMAGEN_CLIENTES_H
+
+#include "bitacora.h"
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+namespace ERP {
+    
+    // Imagen binaria del maestro de clientes, pensada para mapearse con mmap y leerse tal cual:
+    // un proceso que reinicia la abre en milisegundos en vez de recargar la tabla fila por fila,
+    // y los procesos del mismo host comparten sus páginas en el page cache.
+    //
+    //   [CabeceraImagen][RegistroImagen x n, por id][u32 x n: orden (razon_social, id)]
+    //   [u32 x n: orden (ruc, id)][heap de textos]
+    //
+    // Todo se ubica con desplazamientos desde el inicio del archivo (nada de punteros), así
+    // la imagen es válida en cualquier dirección. Los enteros van en el orden del host que la
+    // escribió; marca_orden permite rechazar la de un host con otro orden de bytes.
+    inline constexpr char MAGIA_IMAGEN[8] = {'E', 'R', 'P', 'I', 'M', 'A', 'G', 'N'};
+    inline constexpr uint32_t VERSION_IMAGEN = 1;
+    inline constexpr uint32_t MARCA_ORDEN_IMAGEN = 0x01020304;
+    
+    struct CabeceraImagen {
+        char magia[8];
+        uint32_t version_formato;
+        uint32_t marca_orden;
+        uint32_t tam_cabecera;
+        uint32_t tam_registro;
+        uint64_t num_registros;
+        uint64_t num_activos;
+        uint64_t desp_registros;
+        uint64_t desp_orden;
+        uint64_t desp_por_ruc;
+        uint64_t desp_heap;
+        uint64_t tam_heap;
+        int64_t generada;       // time_t de la escritura
+        uint32_t crc_datos;     // CRC-32 de todo lo que sigue a la cabecera
+        uint32_t crc_cabecera;  // CRC-32 de la cabecera hasta crc_datos inclusive
+    };
+    
+    // Texto en el heap: [desplazamiento, desplazamiento + largo), seguido de un '\0'
+    struct TextoImagen {
+        uint32_t desplazamiento; // Desde el inicio del heap
+        uint32_t largo;
+    };
+    
+    // Registro de ancho fijo. 'textos' sigue el orden de Entidad<Cliente>::columnas sin el id:
+    // codigo, razon_social, ruc, direccion, telefono, email.
+    struct RegistroImagen {
+        int32_t id;
+        int32_t version;
+        TextoImagen textos[6];
+        uint8_t activo;
+        uint8_t reservado[7];
+    };
+    
+    static_assert(sizeof(CabeceraImagen) == 96, "CabeceraImagen cambia el formato en disco");
+    static_assert(sizeof(RegistroImagen) == 64, "RegistroImagen cambia el formato en disco");
+    
+    // Una imagen abierta y mapeada en memoria, de solo lectura. Se comparte con shared_ptr:
+    // las vistas que apuntan a sus registros la mantienen mapeada mientras existan.
+    class ImagenClientes {
+    private:
+        const char* base = nullptr;
+        size_t tamano = 0;
+        const CabeceraImagen* cabecera = nullptr;
+        const RegistroImagen* registros = nullptr;
+        const uint32_t* orden = nullptr;
+        const uint32_t* por_ruc = nullptr;
+        const char* heap = nullptr;
+        #ifdef _WIN32
+        HANDLE archivo = INVALID_HANDLE_VALUE;
+        HANDLE mapeo = nullptr;
+        #endif
+        
+        ImagenClientes() = default;
+        
+    public:
+        ImagenClientes(const ImagenClientes&) = delete;
+        ImagenClientes& operator=(const ImagenClientes&) = delete;
+        
+        ~ImagenClientes() {
+            #ifdef _WIN32
+            if (base) UnmapViewOfFile(base);
+            if (mapeo) CloseHandle(mapeo);
+            if (archivo != INVALID_HANDLE_VALUE) CloseHandle(archivo);
+            #else
+            if (base) ::munmap((void*)base, tamano);
+            #endif
+        }
+        
+        // Mapear y validar la imagen. Sin 'verificar_datos' solo se comprueba la cabecera, que
+        // es lo que hace el arranque instantáneo: el CRC de los datos obliga a leer el archivo
+        // entero. Aun sin él, los accesos con desplazamientos fuera de rango devuelven vacío.
+        static std::shared_ptr<const ImagenClientes> abrir(const std::string& ruta, std::string& error,
+                                                           bool verificar_datos = true) {
+            std::shared_ptr<ImagenClientes> imagen(new ImagenClientes());
+            if (!imagen->mapear(ruta)) {
+                error = "no se pudo mapear " + ruta;
+                return nullptr;
+            }
+            if (!imagen->validar(verificar_datos, error)) return nullptr;
+            return imagen;
+        }
+        
+        size_t cantidad() const { return (size_t)cabecera->num_registros; }
+        long long activos() const { return (long long)cabecera->num_activos; }
+        std::time_t generada() const { return (std::time_t)cabecera->generada; }
+        
+        // i-ésimo registro por id ascendente
+        const RegistroImagen& registro(size_t i) const { return registros[i]; }
+        
+        // i-ésimo registro por (razon_social, id) o por (ruc, id); nullptr si el índice está dañado
+        const RegistroImagen* en_orden(size_t i) const { return indexado(orden, i); }
+        const RegistroImagen* en_orden_ruc(size_t i) const { return indexado(por_ruc, i); }
+        
+        const RegistroImagen* buscar_id(int id) const {
+            const RegistroImagen* fin = registros + cantidad();
+            const RegistroImagen* it = std::lower_bound(registros, fin, id,
+                [](const RegistroImagen& r, int valor) { return r.id < valor; });
+            return it != fin && it->id == id ? it : nullptr;
+        }
+        
+        // Primera posición de 'orden' cuyo (razon_social, id) es mayor que el dado
+        size_t posterior_a(std::string_view razon_social, int id) const {
+            size_t desde = 0, hasta = cantidad();
+            while (desde < hasta) {
+                size_t medio = desde + (hasta - desde) / 2;
+                const RegistroImagen* r = en_orden(medio);
+                int comparacion = r ? texto(*r, 1).compare(razon_social) : 1;
+                if (comparacion < 0 || (comparacion == 0 && r->id <= id)) desde = medio + 1;
+                else hasta = medio;
+            }
+            return desde;
+        }
+        
+        // Primera posición de 'por_ruc' con ese RUC (o mayor)
+        size_t primero_con_ruc(std::string_view ruc) const {
+            size_t desde = 0, hasta = cantidad();
+            while (desde < hasta) {
+                size_t medio = desde + (hasta - desde) / 2;
+                const RegistroImagen* r = en_orden_ruc(medio);
+                if (r && texto(*r, 2) < ruc) desde = medio + 1;
+                else hasta = medio;
+            }
+            return desde;
+        }
+        
+        // Texto k de 'textos' (0 = codigo ... 5 = email)
+        std::string_view texto(const RegistroImagen& r, size_t k) const {
+            const TextoImagen& t = r.textos[k];
+            if (t.desplazamiento > cabecera->tam_heap || t.largo > cabecera->tam_heap - t.desplazamiento) return {};
+            return std::string_view(heap + t.desplazamiento, t.largo);
+        }
+        
+    private:
+        const RegistroImagen* indexado(const uint32_t* indice, size_t i) const {
+            uint32_t posicion = indice[i];
+            return posicion < cantidad() ? &registros[posicion] : nullptr;
+        }
+        
+        bool validar(bool verificar_datos, std::string& error) {
+            if (tamano < sizeof(CabeceraImagen)) {
+                error = "archivo demasiado corto";
+                return false;
+            }
+            cabecera = (const CabeceraImagen*)base;
+            const CabeceraImagen& c = *cabecera;
+            if (std::memcmp(c.magia, MAGIA_IMAGEN, sizeof(MAGIA_IMAGEN)) != 0) {
+                error = "no es una imagen de clientes";
+                return false;
+            }
+            if (c.version_formato != VERSION_IMAGEN || c.marca_orden != MARCA_ORDEN_IMAGEN ||
+                c.tam_cabecera != sizeof(CabeceraImagen) || c.tam_registro != sizeof(RegistroImagen)) {
+                error = "version " + std::to_string(c.version_formato) + " u orden de bytes no soportados";
+                return false;
+            }
+            if (crc32(base, offsetof(CabeceraImagen, crc_cabecera)) != c.crc_cabecera) {
+                error = "cabecera danada";
+                return false;
+            }
+            uint64_t n = c.num_registros;
+            if (n > tamano / sizeof(RegistroImagen) ||
+                !seccion(c.desp_registros, n * sizeof(RegistroImagen)) ||
+                !seccion(c.desp_orden, n * sizeof(uint32_t)) || !seccion(c.desp_por_ruc, n * sizeof(uint32_t)) ||
+                !seccion(c.desp_heap, c.tam_heap) || c.desp_registros % alignof(RegistroImagen) != 0 ||
+                c.desp_orden % alignof(uint32_t) != 0 || c.desp_por_ruc % alignof(uint32_t) != 0) {
+                error = "secciones fuera del archivo";
+                return false;
+            }
+            if (verificar_datos && crc32(base + sizeof(CabeceraImagen), tamano - sizeof(CabeceraImagen)) != c.crc_datos) {
+                error = "datos danados (CRC)";
+                return false;
+            }
+            registros = (const RegistroImagen*)(base + c.desp_registros);
+            orden = (const uint32_t*)(base + c.desp_orden);
+            por_ruc = (const uint32_t*)(base + c.desp_por_ruc);
+            heap = base + c.desp_heap;
+            return true;
+        }
+        
+        bool seccion(uint64_t desplazamiento, uint64_t largo) const {
+            return desplazamiento >= sizeof(CabeceraImagen) && desplazamiento <= tamano && largo <= tamano - desplazamiento;
+        }
+        
+        #ifdef _WIN32
+        bool mapear(const std::string& ruta) {
+            archivo = CreateFileA(ruta.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr,
+                                  OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+            if (archivo == INVALID_HANDLE_VALUE) return false;
+            LARGE_INTEGER largo;
+            if (!GetFileSizeEx(archivo, &largo) || largo.QuadPart == 0) return false;
+            tamano = (size_t)largo.QuadPart;
+            mapeo = CreateFileMappingA(archivo, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            if (!mapeo) return false;
+            base = (const char*)MapViewOfFile(mapeo, FILE_MAP_READ, 0, 0, 0);
+            return base != nullptr;
+        }
+        #else
+        // El descriptor se cierra enseguida: el mapeo sigue vigente aunque el archivo se
+        // reemplace con rename, así se puede publicar una imagen nueva sin cortar a los lectores
+        bool mapear(const std::string& ruta) {
+            int f = ::open(ruta.c_str(), O_RDONLY | O_CLOEXEC);
+            if (f < 0) return false;
+            struct stat info;
+            bool ok = ::fstat(f, &info) == 0 && info.st_size > 0;
+            void* mapa = ok ? ::mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_SHARED, f, 0) : MAP_FAILED;
+            ::close(f);
+            if (mapa == MAP_FAILED) return false;
+            base = (const char*)mapa;
+            tamano = (size_t)info.st_size;
+            #ifdef MADV_WILLNEED
+            ::madvise(mapa, tamano, MADV_WILLNEED); // Leer por adelantado lo que no esté en el page cache
+            #endif
+            return true;
+        }
+        #endif
+    };
+    
+    // Arma una imagen en memoria y la publica de forma atómica (temporal, fsync y rename), así
+    // quien la abra nunca ve un archivo a medias
+    class EscritorImagen {
+    private:
+        std::vector<RegistroImagen> registros;
+        std::string heap;
+        uint64_t activos = 0;
+        
+    public:
+        // 'textos' en el orden de RegistroImagen::textos
+        void agregar(int id, int version, bool activo, const std::array<std::string_view, 6>& textos) {
+            RegistroImagen r{};
+            r.id = id;
+            r.version = version;
+            r.activo = activo ? 1 : 0;
+            for (size_t k = 0; k < textos.size(); k++) {
+                r.textos[k].desplazamiento = (uint32_t)heap.size();
+                r.textos[k].largo = (uint32_t)textos[k].size();
+                heap += textos[k];
+                heap += '\0';
+            }
+            registros.push_back(r);
+            if (activo) activos++;
+        }
+        
+        size_t cantidad() const { return registros.size(); }
+        
+        // false si no se pudo escribir o el heap supera los 4 GB que direcciona TextoImagen
+        bool escribir(const std::string& ruta) {
+            if (heap.size() > UINT32_MAX) return false;
+            std::sort(registros.begin(), registros.end(),
+                      [](const RegistroImagen& a, const RegistroImagen& b) { return a.id < b.id; });
+            auto texto = [&](const RegistroImagen& r, size_t k) {
+                return std::string_view(heap.data() + r.textos[k].desplazamiento, r.textos[k].largo);
+            };
+            std::vector<uint32_t> orden = indice([&](const RegistroImagen& a, const RegistroImagen& b) {
+                int comparacion = texto(a, 1).compare(texto(b, 1));
+                return comparacion < 0 || (comparacion == 0 && a.id < b.id);
+            });
+            std::vector<uint32_t> por_ruc = indice([&](const RegistroImagen& a, const RegistroImagen& b) {
+                int comparacion = texto(a, 2).compare(texto(b, 2));
+                return comparacion < 0 || (comparacion == 0 && a.id < b.id);
+            });
+            
+            std::string_view bytes_registros((const char*)registros.data(), registros.size() * sizeof(RegistroImagen));
+            std::string_view bytes_orden((const char*)orden.data(), orden.size() * sizeof(uint32_t));
+            std::string_view bytes_ruc((const char*)por_ruc.data(), por_ruc.size() * sizeof(uint32_t));
+            
+            CabeceraImagen c{};
+            std::memcpy(c.magia, MAGIA_IMAGEN, sizeof(MAGIA_IMAGEN));
+            c.version_formato = VERSION_IMAGEN;
+            c.marca_orden = MARCA_ORDEN_IMAGEN;
+            c.tam_cabecera = sizeof(CabeceraImagen);
+            c.tam_registro = sizeof(RegistroImagen);
+            c.num_registros = registros.size();
+            c.num_activos = activos;
+            c.desp_registros = sizeof(CabeceraImagen);
+            c.desp_orden = c.desp_registros + bytes_registros.size();
+            c.desp_por_ruc = c.desp_orden + bytes_orden.size();
+            c.desp_heap = c.desp_por_ruc + bytes_ruc.size();
+            c.tam_heap = heap.size();
+            c.generada = (int64_t)std::time(nullptr);
+            uint32_t crc = crc32(bytes_registros.data(), bytes_registros.size());
+            crc = crc32(bytes_orden.data(), bytes_orden.size(), crc);
+            crc = crc32(bytes_ruc.data(), bytes_ruc.size(), crc);
+            c.crc_datos = crc32(heap.data(), heap.size(), crc);
+            c.crc_cabecera = crc32((const char*)&c, offsetof(CabeceraImagen, crc_cabecera));
+            
+            return Bitacora::escribir_atomico(ruta, {std::string_view((const char*)&c, sizeof(c)),
+                                                     bytes_registros, bytes_orden, bytes_ruc, heap});
+        }
+        
+    private:
+        // Posiciones de 'registros' ordenadas según 'menor'
+        template<typename Menor>
+        std::vector<uint32_t> indice(Menor menor) const {
+            std::vector<uint32_t> posiciones(registros.size());
+            for (size_t i = 0; i < posiciones.size(); i++) posiciones[i] = (uint32_t)i;
+            std::sort(posiciones.begin(), posiciones.end(),
+                      [&](uint32_t a, uint32_t b) { return menor(registros[a], registros[b]); });
+            return posiciones;
+        }
+    };
+    
+} // namespace ERP
+
+#endif
@@ -0,0 +1,268 @@
+#ifndef MIGRACIONES_H
+#define MIGRACIONES_H
+
+#include "database.h"
+#include "transaccion.h"
+#include <string>
+#include <vector>
+#include <map>
+#include <cstdint>
+#include <cstdio>
+#include <chrono>
+#include <thread>
+
+namespace ERP {
+    
+    struct Migracion {
+        int version;
+        std::string descripcion;
+        std::string sql;
+        // CREATE INDEX CONCURRENTLY no puede ir dentro de una transacción: estas migraciones
+        // deben ser una sola sentencia idempotente y se ejecutan en autocommit
+        bool concurrente = false;
+        // Índice que crea la migración concurrente. Si un intento anterior falló quedó INVALID
+        // y IF NOT EXISTS lo saltaría: se borra antes de reintentar. Fuera del SQL para no
+        // alterar el checksum de las migraciones ya publicadas.
+        std::string indice;
+    };
+    
+    // Migraciones en orden de versión. Nunca editar una ya publicada (su checksum quedó
+    // registrado en schema_version): los cambios se agregan como una migración nueva al final.
+    inline const std::vector<Migracion>& migraciones_erp() {
+        static const std::vector<Migracion> lista = {
+            {1, "Esquema inicial de clientes", R"(
+                CREATE TABLE IF NOT EXISTS clientes (
+                    id SERIAL PRIMARY KEY,
+                    codigo VARCHAR(20) UNIQUE NOT NULL,
+                    razon_social VARCHAR(200) NOT NULL,
+                    ruc VARCHAR(11) UNIQUE NOT NULL,
+                    direccion TEXT,
+                    telefono VARCHAR(20),
+                    email VARCHAR(100),
+                    activo BOOLEAN DEFAULT true,
+                    fecha_creacion TIMESTAMP DEFAULT CURRENT_TIMESTAMP,
+                    fecha_actualizacion TIMESTAMP DEFAULT CURRENT_TIMESTAMP
+                );
+                
+                CREATE INDEX IF NOT EXISTS idx_clientes_codigo ON clientes(codigo);
+                CREATE INDEX IF NOT EXISTS idx_clientes_ruc ON clientes(ruc);
+                CREATE INDEX IF NOT EXISTS idx_clientes_activo ON clientes(activo);
+            )"},
+            {2, "Indice keyset (razon_social, id) de clientes activos", R"(
+                CREATE INDEX CONCURRENTLY IF NOT EXISTS idx_clientes_razon_social_id
+                    ON clientes(razon_social, id) WHERE activo = true
+            )", true, "idx_clientes_razon_social_id"},
+            {3, "Trigger de notificacion de cambios en clientes", std::string(R"(
+                CREATE OR REPLACE FUNCTION erp_notificar_cambio() RETURNS trigger AS $$
+                BEGIN
+                    PERFORM pg_notify(')") + CANAL_CAMBIOS + R"(', TG_TABLE_NAME || ':' ||
+                                      CASE WHEN TG_OP = 'DELETE' THEN OLD.id ELSE NEW.id END);
+                    RETURN NULL;
+                END;
+                $$ LANGUAGE plpgsql;
+                
+                DROP TRIGGER IF EXISTS trg_clientes_notificar ON clientes;
+                CREATE TRIGGER trg_clientes_notificar AFTER INSERT OR UPDATE OR DELETE ON clientes
+                    FOR EACH ROW EXECUTE FUNCTION erp_notificar_cambio();
+            )"},
+            {4, "Extension pg_trgm para busqueda por similitud", R"(
+                CREATE EXTENSION IF NOT EXISTS pg_trgm;
+            )"},
+            {5, "Indice trigram de razon_social", R"(
+                CREATE INDEX CONCURRENTLY IF NOT EXISTS idx_clientes_razon_social_trgm
+                    ON clientes USING gin (razon_social gin_trgm_ops) WHERE activo = true
+            )", true, "idx_clientes_razon_social_trgm"},
+            {6, "Indice trigram de codigo", R"(
+                CREATE INDEX CONCURRENTLY IF NOT EXISTS idx_clientes_codigo_trgm
+                    ON clientes USING gin (codigo gin_trgm_ops) WHERE activo = true
+            )", true, "idx_clientes_codigo_trgm"},
+            {7, "Indice trigram de ruc", R"(
+                CREATE INDEX CONCURRENTLY IF NOT EXISTS idx_clientes_ruc_trgm
+                    ON clientes USING gin (ruc gin_trgm_ops) WHERE activo = true
+            )", true, "idx_clientes_ruc_trgm"},
+            {8, "Version de fila para concurrencia optimista", R"(
+                ALTER TABLE clientes ADD COLUMN IF NOT EXISTS version INTEGER NOT NULL DEFAULT 1;
+                
+                CREATE OR REPLACE FUNCTION erp_incrementar_version() RETURNS trigger AS $$
+                BEGIN
+                    NEW.version := OLD.version + 1;
+                    RETURN NEW;
+                END;
+                $$ LANGUAGE plpgsql;
+                
+                DROP TRIGGER IF EXISTS trg_clientes_version ON clientes;
+                CREATE TRIGGER trg_clientes_version BEFORE UPDATE ON clientes
+                    FOR EACH ROW EXECUTE FUNCTION erp_incrementar_version();
+            )"},
+            {9, "Indice keyset cubriente para listados con ?fields=id,codigo,razon_social", R"(
+                CREATE INDEX CONCURRENTLY IF NOT EXISTS idx_clientes_razon_social_id_cubriente
+                    ON clientes(razon_social, id) INCLUDE (codigo) WHERE activo = true
+            )", true, "idx_clientes_razon_social_id_cubriente"},
+            {10, "Quitar el indice keyset reemplazado por el cubriente", R"(
+                DROP INDEX CONCURRENTLY IF EXISTS idx_clientes_razon_social_id
+            )", true},
+            {11, "Indice de prefijo de codigo (LIKE 'abc%' con cualquier collation)", R"(
+                CREATE INDEX CONCURRENTLY IF NOT EXISTS idx_clientes_codigo_patron
+                    ON clientes(codigo varchar_pattern_ops)
+            )", true, "idx_clientes_codigo_patron"},
+            {12, "Indice de fecha_actualizacion para ?updated_after=", R"(
+                CREATE INDEX CONCURRENTLY IF NOT EXISTS idx_clientes_fecha_actualizacion
+                    ON clientes(fecha_actualizacion)
+            )", true, "idx_clientes_fecha_actualizacion"},
+        };
+        return lista;
+    }
+    
+    // Aplica las migraciones pendientes contra el primario. En el camino rápido (esquema al
+    // día) solo lee schema_version: no envía DDL ni toma locks de catálogo.
+    class Migrador {
+    private:
+        Database& db;
+        const std::vector<Migracion>& migraciones;
+        
+        // Lock de sesión para que dos instancias arrancando a la vez no migren en paralelo
+        static constexpr long long LOCK_MIGRACIONES = 0x4552504D494752LL; // "ERPMIGR"
+        
+    public:
+        Migrador(Database& database, const std::vector<Migracion>& lista = migraciones_erp())
+            : db(database), migraciones(lista) {}
+        
+        // FNV-1a de 64 bits del SQL, en hexadecimal
+        static std::string checksum(const std::string& sql) {
+            uint64_t hash = 14695981039346656037ULL;
+            for (unsigned char c : sql) {
+                hash ^= c;
+                hash *= 1099511628211ULL;
+            }
+            char buffer[17];
+            snprintf(buffer, sizeof(buffer), "%016llx", (unsigned long long)hash);
+            return buffer;
+        }
+        
+        bool aplicar() {
+            std::map<int, std::string> aplicadas;
+            if (!leer_aplicadas(aplicadas)) return false;
+            if (al_dia(aplicadas)) return validar(aplicadas);
+            
+            // Hay trabajo: serializar con otras instancias y releer bajo el lock
+            if (!tomar_lock()) return false;
+            
+            bool ok = db.execute(
+                "CREATE TABLE IF NOT EXISTS schema_version ("
+                "version INTEGER PRIMARY KEY, "
+                "descripcion TEXT NOT NULL, "
+                "checksum VARCHAR(16) NOT NULL, "
+                "aplicada_en TIMESTAMP DEFAULT CURRENT_TIMESTAMP)");
+            aplicadas.clear();
+            ok = ok && leer_aplicadas(aplicadas) && validar(aplicadas);
+            
+            for (const auto& m : migraciones) {
+                if (!ok) break;
+                if (aplicadas.count(m.version)) continue;
+                std::cout << "Aplicando migración " << m.version << ": " << m.descripcion << std::endl;
+                ok = ejecutar(m);
+            }
+            
+            PGresult* res = db.query("SELECT pg_advisory_unlock(" + std::to_string(LOCK_MIGRACIONES) + ")");
+            if (res) PQclear(res);
+            return ok;
+        }
+        
+    private:
+        // pg_try_advisory_lock con espera entre intentos en vez de pg_advisory_lock: una sentencia
+        // bloqueada retiene su snapshot, y el CREATE INDEX CONCURRENTLY de la instancia que tiene
+        // el lock espera a que terminen los snapshots anteriores, así que ambas quedarían trabadas
+        bool tomar_lock() {
+            const std::string sql = "SELECT pg_try_advisory_lock(" + std::to_string(LOCK_MIGRACIONES) + ")";
+            for (bool avisado = false;; avisado = true) {
+                PGresult* res = db.query(sql);
+                if (!res) return false;
+                bool tomado = PQgetvalue(res, 0, 0)[0] == 't';
+                PQclear(res);
+                if (tomado) return true;
+                if (!avisado) std::cout << "Otra instancia está migrando; esperando el lock..." << std::endl;
+                std::this_thread::sleep_for(std::chrono::milliseconds(500));
+            }
+        }
+        
+        bool leer_aplicadas(std::map<int, std::string>& aplicadas) {
+            PGresult* res = db.query("SELECT to_regclass('schema_version') IS NOT NULL");
+            if (!res) return false;
+            bool existe = PQgetvalue(res, 0, 0)[0] == 't';
+            PQclear(res);
+            if (!existe) return true;
+            
+            res = db.query("SELECT version, checksum FROM schema_version ORDER BY version");
+            if (!res) return false;
+            for (int i = 0; i < PQntuples(res); i++) {
+                aplicadas[std::stoi(PQgetvalue(res, i, 0))] = PQgetvalue(res, i, 1);
+            }
+            PQclear(res);
+            return true;
+        }
+        
+        bool al_dia(const std::map<int, std::string>& aplicadas) const {
+            for (const auto& m : migraciones) {
+                if (!aplicadas.count(m.version)) return false;
+            }
+            return true;
+        }
+        
+        // Una migración ya aplicada cuyo SQL cambió indica que el código y la base divergieron
+        bool validar(const std::map<int, std::string>& aplicadas) const {
+            for (const auto& m : migraciones) {
+                auto it = aplicadas.find(m.version);
+                if (it != aplicadas.end() && it->second != checksum(m.sql)) {
+                    std::cerr << "Checksum distinto en migración " << m.version << " (" << m.descripcion
+                              << "): no se deben editar migraciones ya aplicadas" << std::endl;
+                    return false;
+                }
+            }
+            return true;
+        }
+        
+        bool ejecutar(const Migracion& m) {
+            std::string registro = "INSERT INTO schema_version (version, descripcion, checksum) VALUES (" +
+                                   std::to_string(m.version) + ", '" + escape_sql(m.descripcion) + "', '" +
+                                   checksum(m.sql) + "')";
+            
+            if (m.concurrente) {
+                if (!descartar_indice_invalido(m)) return false;
+                if (!db.execute(m.sql)) {
+                    descartar_indice_invalido(m); // No dejar el INVALID hasta el próximo arranque
+                    return false;
+                }
+                return db.execute(registro);
+            }
+            
+            Transaccion tx(db);
+            return tx.activa() && db.execute(m.sql) && db.execute(registro) && tx.confirmar();
+        }
+        
+        // Un CREATE INDEX CONCURRENTLY que falla (deadlock, cancelación, duplicado en un índice
+        // único) deja el índice creado pero con indisvalid = false
+        bool descartar_indice_invalido(const Migracion& m) {
+            if (m.indice.empty()) return true;
+            PGresult* res = db.query("SELECT indisvalid FROM pg_index WHERE indexrelid = to_regclass('" +
+                                     escape_sql(m.indice) + "')");
+            if (!res) return false;
+            bool invalido = PQntuples(res) == 1 && PQgetvalue(res, 0, 0)[0] != 't';
+            PQclear(res);
+            if (!invalido) return true;
+            std::cout << "Borrando índice inválido " << m.indice << " de un intento anterior" << std::endl;
+            return db.execute("DROP INDEX CONCURRENTLY IF EXISTS " + m.indice);
+        }
+        
+        static std::string escape_sql(const std::string& str) {
+            std::string result;
+            for (char c : str) {
+                if (c == '\'') result += "''";
+                else result += c;
+            }
+            return result;
+        }
+    };
+    
+} // namespace ERP
+
+#endif
@@ -8,23 +8,156 @@
 #include <map>
 #include <functional>
 #include <sstream>
+#include <cstdio>
+#include <cctype>
+#include <cstdlib>
+#include <vector>
 
 #pragma comment(lib, "ws2_32.lib")
 
 class MiniServer {
+public:
+    // Escritor de chunks para respuestas en streaming; devuelve false si el cliente se desconectó
+    using ChunkWriter = std::function<bool(const char*, size_t)>;
+    using Handler = std::function<std::string(const std::string&, const std::string&)>;
+    // Handlers diferidos: la respuesta se envía cuando el handler invoca 'respond' (p. ej. al llegar
+    // el resultado de una query asíncrona), sin bloquear el bucle mientras tanto
+    using Responder = std::function<void(const std::string&)>;
+    using AsyncHandler = std::function<void(const std::string&, const std::string&, Responder)>;
+    // Fuente externa de sockets (p. ej. conexiones a PostgreSQL) vigilada por el mismo select()
+    struct PollSource {
+        std::function<void(std::vector<int>& read, std::vector<int>& write)> sockets;
+        std::function<void()> on_ready;
+    };
+    // Devuelve false si la respuesta quedó incompleta: se omite el chunk final para que el cliente lo detecte
+    using StreamHandler = std::function<bool(const std::string&, const ChunkWriter&)>;
+
 private:
+    struct StreamRoute {
+        std::string content_type;
+        StreamHandler handler;
+    };
+    
     SOCKET server_socket;
     int port;
     bool running;
-    std::map<std::string, std::function<std::string(const std::string&, const std::string&)>> routes;
+    // Claves "METODO /ruta"; se elige el prefijo más largo que coincida
+    std::map<std::string, Handler> routes;
+    std::map<std::string, StreamRoute> stream_routes;
+    std::map<std::string, AsyncHandler> async_routes;
+    std::vector<PollSource> poll_sources;
+    SOCKET current_client = INVALID_SOCKET; // Cliente atendido por un handler síncrono
+    int current_status = 200;               // Código HTTP de su respuesta (set_status)
+
+    template <typename T>
+    static const T* find_route(const std::map<std::string, T>& table, const std::string& method,
+                               const std::string& path, size_t& best) {
+        const T* found = nullptr;
+        best = 0;
+        std::string key = method + " " + path;
+        for (const auto& route : table) {
+            if (key.compare(0, route.first.size(), route.first) == 0 && route.first.size() > best) {
+                found = &route.second;
+                best = route.first.size();
+            }
+        }
+        return found;
+    }
+    
+    static bool send_all(SOCKET client_socket, const char* data, size_t len) {
+        while (len > 0) {
+            int sent = send(client_socket, data, (int)len, 0);
+            if (sent == SOCKET_ERROR || sent == 0) return false;
+            data += sent;
+            len -= (size_t)sent;
+        }
+        return true;
+    }
+    
+    static void send_response(SOCKET client_socket, const std::string& response_content, int status = 200) {
+        std::string response = common_headers("application/json", status);
+        response += "Content-Length: " + std::to_string(response_content.length()) + "\r\n";
+        response += "Connection: close\r\n\r\n";
+        response += response_content;
+        
+        send_all(client_socket, response.c_str(), response.length());
+    }
+    
+    static std::string common_headers(const std::string& content_type, int status = 200) {
+        std::string headers = "HTTP/1.1 " + std::to_string(status) + " " + status_text(status) + "\r\n";
+        headers += "Content-Type: " + content_type + "\r\n";
+        headers += "Access-Control-Allow-Origin: *\r\n";
+        headers += "Access-Control-Allow-Methods: GET, POST, PUT, DELETE, OPTIONS\r\n";
+        headers += "Access-Control-Allow-Headers: Content-Type\r\n";
+        return headers;
+    }
+    
+    static const char* status_text(int status) {
+        switch (status) {
+            case 200: return "OK";
+            case 400: return "Bad Request";
+            case 404: return "Not Found";
+            case 409: return "Conflict";
+            case 500: return "Internal Server Error";
+            case 503: return "Service Unavailable";
+            default: return "Status";
+        }
+    }
+    
+    void handle_stream(SOCKET client_socket, const std::string& path, const StreamRoute& route) {
+        std::string headers = common_headers(route.content_type);
+        headers += "Transfer-Encoding: chunked\r\n";
+        headers += "Connection: close\r\n\r\n";
+        
+        bool ok = send_all(client_socket, headers.c_str(), headers.length());
+        ChunkWriter writer = [&](const char* data, size_t len) {
+            if (!ok) return false;
+            if (len == 0) return true;
+            char size_line[32];
+            int n = snprintf(size_line, sizeof(size_line), "%zx\r\n", len);
+            ok = send_all(client_socket, size_line, (size_t)n) &&
+                 send_all(client_socket, data, len) &&
+                 send_all(client_socket, "\r\n", 2);
+            return ok;
+        };
+        
+        bool completed = ok && route.handler(path, writer);
+        if (completed && ok) send_all(client_socket, "0\r\n\r\n", 5);
+    }
+
+    // Leer headers y el cuerpo completo según Content-Length (hasta 64MB)
+    static std::string read_request(SOCKET client_socket) {
+        const size_t max_request = 64 * 1024 * 1024;
+        std::string request;
+        char buffer[8192];
+        size_t expected = std::string::npos;
+        
+        while (request.size() < expected && request.size() < max_request) {
+            int bytes_received = recv(client_socket, buffer, sizeof(buffer), 0);
+            if (bytes_received <= 0) break;
+            request.append(buffer, (size_t)bytes_received);
+            
+            if (expected == std::string::npos) {
+                size_t header_end = request.find("\r\n\r\n");
+                if (header_end == std::string::npos) continue;
+                size_t content_length = 0;
+                std::string headers = request.substr(0, header_end);
+                for (auto& c : headers) c = (char)tolower((unsigned char)c);
+                size_t pos = headers.find("\r\ncontent-length:");
+                if (pos != std::string::npos) {
+                    content_length = std::strtoul(headers.c_str() + pos + 17, nullptr, 10);
+                }
+                expected = header_end + 4 + content_length;
+            }
+        }
+        return request;
+    }
 
     void handle_client(SOCKET client_socket) {
-        char buffer[4096];
-        int bytes_received = recv(client_socket, buffer, sizeof(buffer) - 1, 0);
+        std::string request = read_request(client_socket);
         
-        if (bytes_received > 0) {
-            buffer[bytes_received] = '\0';
-            std::string request(buffer);
+        if (!request.empty()) {
+            current_client = client_socket;
             
             // Parsear método y ruta
             std::istringstream iss(request);
@@ -38,30 +171,40 @@ private:
                 body = request.substr(body_pos + 4);
             }
             
+            // Buscar ruta: gana el prefijo más específico entre rutas normales, de streaming y diferidas
+            size_t handler_len, stream_len, async_len;
+            const Handler* handler = find_route(routes, method, path, handler_len);
+            const StreamRoute* stream = find_route(stream_routes, method, path, stream_len);
+            const AsyncHandler* async = find_route(async_routes, method, path, async_len);
+            
+            if (stream && stream_len >= handler_len && stream_len >= async_len) {
+                handle_stream(client_socket, path, *stream);
+                current_client = INVALID_SOCKET;
+                closesocket(client_socket);
+                return;
+            }
+            
+            if (async && async_len >= handler_len) {
+                // El socket queda abierto hasta que el handler responda
+                (*async)(path, body, [client_socket](const std::string& content) {
+                    send_response(client_socket, content);
+                    closesocket(client_socket);
+                });
+                current_client = INVALID_SOCKET;
+                return;
+            }
+            
             std::string response_content = "{\"error\":\"Ruta no encontrada\"}";
-            std::string content_type = "application/json";
             
-            // Buscar ruta
-            for (const auto& route : routes) {
-                if (path.find(route.first) == 0) {
-                    response_content = route.second(method, body);
-                    break;
-                }
+            current_status = 200;
+            if (handler) {
+                response_content = (*handler)(path, body);
             }
             
-            // Construir respuesta HTTP
-            std::string response = "HTTP/1.1 200 OK\r\n";
-            response += "Content-Type: " + content_type + "\r\n";
-            response += "Access-Control-Allow-Origin: *\r\n";
-            response += "Access-Control-Allow-Methods: GET, POST, PUT, DELETE, OPTIONS\r\n";
-            response += "Access-Control-Allow-Headers: Content-Type\r\n";
-            response += "Content-Length: " + std::to_string(response_content.length()) + "\r\n";
-            response += "Connection: close\r\n\r\n";
-            response += response_content;
-            
-            send(client_socket, response.c_str(), response.length(), 0);
+            send_response(client_socket, response_content, current_status);
         }
         
+        current_client = INVALID_SOCKET;
         closesocket(client_socket);
     }
 
@@ -78,16 +221,87 @@ public:
         WSACleanup();
     }
     
-    void get(const std::string& path, std::function<std::string(const std::string&, const std::string&)> handler) {
-        routes[path] = handler;
+    // Obtener un parámetro de la query string de la ruta ("/api/x?clave=valor&...")
+    static std::string query_param(const std::string& path, const std::string& key) {
+        size_t query_pos = path.find('?');
+        if (query_pos == std::string::npos) return "";
+        
+        std::istringstream iss(path.substr(query_pos + 1));
+        std::string pair;
+        while (std::getline(iss, pair, '&')) {
+            size_t pos = pair.find('=');
+            if (pos != std::string::npos && pair.compare(0, pos, key) == 0 && pos == key.size()) {
+                return decode_url(pair.substr(pos + 1));
+            }
+        }
+        return "";
+    }
+    
+    // Decodificar %XX y '+' de la query string
+    static std::string decode_url(const std::string& s) {
+        std::string result;
+        for (size_t i = 0; i < s.size(); i++) {
+            if (s[i] == '+') {
+                result += ' ';
+            } else if (s[i] == '%' && i + 2 < s.size() && isxdigit((unsigned char)s[i + 1]) && isxdigit((unsigned char)s[i + 2])) {
+                result += (char)std::stoi(s.substr(i + 1, 2), nullptr, 16);
+                i += 2;
+            } else {
+                result += s[i];
+            }
+        }
+        return result;
+    }
+    
+    // Dentro de un handler síncrono: código HTTP de la respuesta (200 si no se llama)
+    void set_status(int status) {
+        current_status = status;
+    }
+    
+    // Dentro de un handler síncrono o de streaming: true si el cliente ya cerró la conexión
+    // (el socket está legible pero recv no devuelve datos)
+    bool client_disconnected() const {
+        if (current_client == INVALID_SOCKET) return false;
+        fd_set fds;
+        FD_ZERO(&fds);
+        FD_SET(current_client, &fds);
+        timeval timeout;
+        timeout.tv_sec = 0;
+        timeout.tv_usec = 0;
+        if (select(0, &fds, NULL, NULL, &timeout) <= 0) return false;
+        char c;
+        return recv(current_client, &c, 1, MSG_PEEK) <= 0;
     }
     
-    void post(const std::string& path, std::function<std::string(const std::string&, const std::string&)> handler) {
-        routes[path] = handler;
+    // Los handlers reciben la ruta completa (incluida la query string) y el cuerpo
+    void get(const std::string& path, Handler handler) {
+        routes["GET " + path] = handler;
     }
     
-    void del(const std::string& path, std::function<std::string(const std::string&, const std::string&)> handler) {
-        routes[path] = handler;
+    void post(const std::string& path, Handler handler) {
+        routes["POST " + path] = handler;
+    }
+    
+    void put(const std::string& path, Handler handler) {
+        routes["PUT " + path] = handler;
+    }
+    
+    void del(const std::string& path, Handler handler) {
+        routes["DELETE " + path] = handler;
+    }
+    
+    // GET respondido de forma diferida desde el bucle de eventos
+    void get_async(const std::string& path, AsyncHandler handler) {
+        async_routes["GET " + path] = handler;
+    }
+    
+    void add_poll_source(PollSource source) {
+        poll_sources.push_back(source);
+    }
+    
+    // GET cuya respuesta se envía con Transfer-Encoding: chunked a medida que se produce
+    void get_stream(const std::string& path, const std::string& content_type, StreamHandler handler) {
+        stream_routes["GET " + path] = {content_type, handler};
     }
     
     bool start() {
@@ -118,27 +332,43 @@ public:
         std::cout << "Servidor iniciado en http://localhost:" << port << std::endl;
         std::cout << "Presiona Ctrl+C para detener el servidor" << std::endl;
         
-        // Bucle principal SIN hilos - maneja una conexión a la vez
+        // Bucle principal SIN hilos - maneja una conexión a la vez; las rutas diferidas
+        // quedan abiertas mientras sus queries avanzan en las fuentes externas
         while (running) {
             sockaddr_in client_addr;
             int client_addr_size = sizeof(client_addr);
             
-            // Usar select para no bloquear indefinidamente
-            fd_set readfds;
+            // Usar select para no bloquear indefinidamente; incluye los sockets de las fuentes externas
+            fd_set readfds, writefds;
             FD_ZERO(&readfds);
+            FD_ZERO(&writefds);
             FD_SET(server_socket, &readfds);
             
+            std::vector<int> source_read, source_write;
+            for (const auto& source : poll_sources) {
+                source.sockets(source_read, source_write);
+            }
+            for (int s : source_read) FD_SET((SOCKET)s, &readfds);
+            for (int s : source_write) FD_SET((SOCKET)s, &writefds);
+            
             timeval timeout;
             timeout.tv_sec = 1;
             timeout.tv_usec = 0;
             
-            int activity = select(0, &readfds, NULL, NULL, &timeout);
+            int activity = select(0, &readfds, &writefds, NULL, &timeout);
             
             if (activity == SOCKET_ERROR) {
                 std::cerr << "Error en select: " << WSAGetLastError() << std::endl;
                 break;
             }
             
+            // Entregar completados antes de aceptar nuevas conexiones
+            if (activity > 0 && (!source_read.empty() || !source_write.empty())) {
+                for (const auto& source : poll_sources) {
+                    source.on_ready();
+                }
+            }
+            
             if (activity > 0 && FD_ISSET(server_socket, &readfds)) {
                 SOCKET client_socket = accept(server_socket, (sockaddr*)&client_addr, &client_addr_size);
                 
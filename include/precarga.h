@@ -0,0 +1,295 @@
+#ifndef PRECARGA_H
+#define PRECARGA_H
+
+#include "cache_clientes.h"
+#include <libpq-fe.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace ERP {
+    
+    // Precarga de la caché de clientes al arrancar, para que el tráfico que llega después de
+    // un deploy no caiga entero sobre PostgreSQL. El rango de ids se parte en trozos que
+    // 'conexiones' hilos toman de una cola común, cada uno con su propia conexión (las de
+    // Database atienden peticiones y son una por servidor). Al terminar, o al vencer el plazo
+    // (se cancelan las consultas en curso), lista() pasa a true; un fallo también la deja
+    // lista: la caché es read-through y sin precarga solo arranca fría.
+    class PrecargaClientes {
+    public:
+        enum class Estado { Pendiente, EnCurso, Completa, Agotada, Fallida };
+        
+        struct Informe {
+            Estado estado = Estado::Pendiente;
+            long long filas = 0;            // Guardadas en la caché
+            long long filas_descartadas = 0; // Leídas pero no guardadas (invalidadas mientras tanto)
+            long long duracion_ms = 0;
+            double filas_por_segundo = 0;
+            int conexiones = 0;
+            int rangos = 0;
+            int rangos_fallidos = 0;
+        };
+        
+    private:
+        using Repo = Repositorio<Cliente>;
+        
+        static constexpr char DESPUES_RANGO[] = " WHERE id >= $1 AND id < $2";
+        static constexpr const char* SQL_RANGO = Repo::SELECT_CON<DESPUES_RANGO>.c_str();
+        
+        std::string conninfo;
+        CacheClientes& cache;
+        int conexiones;
+        std::chrono::milliseconds plazo;
+        std::function<void()> al_terminar;
+        
+        mutable std::mutex mtx;
+        std::condition_variable cambio;
+        Informe resultado;
+        bool terminada = false;
+        bool detenido = false;
+        int trabajando = 0;
+        std::vector<PGcancel*> cancelaciones; // Una por conexión de trabajo abierta
+        std::thread hilo;
+        
+        std::atomic<int> siguiente_rango{0};
+        std::atomic<int> rangos_hechos{0};
+        std::atomic<int> rangos_fallidos{0};
+        std::atomic<long long> filas{0};
+        std::atomic<long long> filas_descartadas{0};
+        bool tabla_vacia = false;
+        
+    public:
+        // 'al_terminar' corre en el hilo de la precarga antes de marcarla lista (p. ej. armar
+        // la respuesta del listado completo)
+        PrecargaClientes(std::string conninfo_, CacheClientes& cache_, int conexiones_ = 4,
+                         std::chrono::milliseconds plazo_ = std::chrono::seconds(60),
+                         std::function<void()> al_terminar_ = nullptr)
+            : conninfo(std::move(conninfo_)), cache(cache_), conexiones(std::max(1, conexiones_)),
+              plazo(plazo_), al_terminar(std::move(al_terminar_)) {}
+        
+        ~PrecargaClientes() {
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+                detenido = true;
+                for (PGcancel* c : cancelaciones) cancelar(c);
+            }
+            cambio.notify_all();
+            if (hilo.joinable()) hilo.join();
+        }
+        
+        PrecargaClientes(const PrecargaClientes&) = delete;
+        PrecargaClientes& operator=(const PrecargaClientes&) = delete;
+        
+        // Arranca en segundo plano; el servidor puede atender mientras tanto
+        void iniciar() {
+            std::lock_guard<std::mutex> lock(mtx);
+            resultado.estado = Estado::EnCurso;
+            hilo = std::thread(&PrecargaClientes::ejecutar, this);
+        }
+        
+        bool lista() const {
+            std::lock_guard<std::mutex> lock(mtx);
+            return terminada;
+        }
+        
+        Informe informe() const {
+            std::lock_guard<std::mutex> lock(mtx);
+            Informe i = resultado;
+            i.filas = filas;
+            i.filas_descartadas = filas_descartadas;
+            i.rangos_fallidos = rangos_fallidos;
+            return i;
+        }
+        
+        static const char* nombre(Estado estado) {
+            switch (estado) {
+                case Estado::Pendiente: return "pendiente";
+                case Estado::EnCurso: return "en_curso";
+                case Estado::Completa: return "completa";
+                case Estado::Agotada: return "plazo_agotado";
+                default: return "fallida";
+            }
+        }
+        
+    private:
+        void ejecutar() {
+            auto inicio = std::chrono::steady_clock::now();
+            auto limite = inicio + plazo;
+            Estado estado = Estado::Fallida;
+            int rangos = 0;
+            
+            long long minimo, maximo;
+            if (rango_ids(limite, minimo, maximo)) {
+                // Varios trozos por conexión: si un rango tiene más filas, los demás hilos siguen
+                // con el resto de la cola
+                long long ancho = std::max(1LL, (maximo - minimo + 1 + conexiones * 8 - 1) / (conexiones * 8));
+                rangos = (int)((maximo - minimo + ancho) / ancho);
+                
+                std::vector<std::thread> hilos;
+                {
+                    std::lock_guard<std::mutex> lock(mtx);
+                    resultado.conexiones = conexiones;
+                    resultado.rangos = rangos;
+                    trabajando = conexiones;
+                }
+                for (int i = 0; i < conexiones; i++) {
+                    hilos.emplace_back(&PrecargaClientes::trabajar, this, limite, minimo, ancho, rangos);
+                }
+                
+                {
+                    std::unique_lock<std::mutex> lock(mtx);
+                    bool a_tiempo = cambio.wait_until(lock, limite, [this] { return trabajando == 0 || detenido; });
+                    if (!a_tiempo || detenido) {
+                        detenido = true;
+                        for (PGcancel* c : cancelaciones) cancelar(c);
+                    }
+                    if (!a_tiempo) estado = Estado::Agotada;
+                    else if (!detenido && rangos_hechos == rangos) estado = Estado::Completa;
+                }
+                for (auto& h : hilos) h.join();
+            } else if (tabla_vacia) {
+                estado = Estado::Completa;
+            } else if (std::chrono::steady_clock::now() >= limite) {
+                estado = Estado::Agotada;
+            }
+            
+            if (al_terminar && !detener_pedido()) al_terminar();
+            
+            auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - inicio).count();
+            std::lock_guard<std::mutex> lock(mtx);
+            resultado.estado = estado;
+            resultado.duracion_ms = ms;
+            resultado.filas_por_segundo = ms > 0 ? filas * 1000.0 / ms : (double)filas;
+            terminada = true;
+            std::cout << "Precarga de clientes " << nombre(estado) << ": " << filas << " filas en " << ms << " ms ("
+                      << (long long)resultado.filas_por_segundo << " filas/s, " << resultado.conexiones << " conexiones, "
+                      << rangos << " rangos, " << rangos_fallidos << " fallidos, " << filas_descartadas
+                      << " filas descartadas)" << std::endl;
+        }
+        
+        // min(id) y max(id); false si no hay filas (tabla_vacia) o no se pudo consultar
+        bool rango_ids(std::chrono::steady_clock::time_point limite, long long& minimo, long long& maximo) {
+            PGconn* conn = conectar(limite);
+            bool ok = false;
+            if (conn) {
+                PGresult* res = PQexec(conn, "SELECT min(id), max(id) FROM clientes");
+                if (PQresultStatus(res) == PGRES_TUPLES_OK && PQntuples(res) == 1) {
+                    tabla_vacia = PQgetisnull(res, 0, 0);
+                    if (!tabla_vacia) {
+                        minimo = std::atoll(PQgetvalue(res, 0, 0));
+                        maximo = std::atoll(PQgetvalue(res, 0, 1));
+                        ok = true;
+                    }
+                } else {
+                    std::cerr << "Precarga: " << PQerrorMessage(conn) << std::endl;
+                }
+                PQclear(res);
+                PQfinish(conn);
+            }
+            return ok;
+        }
+        
+        void trabajar(std::chrono::steady_clock::time_point limite, long long minimo, long long ancho, int rangos) {
+            PGconn* conn = conectar(limite);
+            PGcancel* cancelacion = nullptr;
+            if (conn) {
+                std::lock_guard<std::mutex> lock(mtx);
+                cancelacion = PQgetCancel(conn);
+                cancelaciones.push_back(cancelacion);
+            }
+            
+            while (cancelacion && !detener_pedido()) {
+                int i = siguiente_rango++;
+                if (i >= rangos) break;
+                std::string desde = std::to_string(minimo + i * ancho);
+                std::string hasta = std::to_string(minimo + (i + 1) * ancho);
+                const char* valores[2] = {desde.c_str(), hasta.c_str()};
+                // Épocas tomadas justo antes de la consulta del rango: una invalidación durante
+                // los rangos anteriores no descarta las filas de este, que ya la ven
+                std::vector<uint64_t> marca = cache.marcar();
+                PGresult* res = PQexecParams(conn, SQL_RANGO, 2, nullptr, valores, nullptr, nullptr, 0);
+                if (PQresultStatus(res) != PGRES_TUPLES_OK) {
+                    if (!detener_pedido()) std::cerr << "Precarga: " << PQerrorMessage(conn) << std::endl;
+                    PQclear(res);
+                    rangos_fallidos++;
+                    continue;
+                }
+                ResultadoCompartido resultado_rango = compartir(res);
+                auto columnas = VistaCliente::columnas(res);
+                int n = PQntuples(res);
+                long long guardadas = 0;
+                for (int fila = 0; fila < n; fila++) {
+                    if (cache.precargar(VistaCliente(resultado_rango, columnas, fila).materializar(), marca)) guardadas++;
+                }
+                filas += guardadas;
+                filas_descartadas += n - guardadas;
+                rangos_hechos++;
+            }
+            
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+                if (cancelacion) {
+                    cancelaciones.erase(std::find(cancelaciones.begin(), cancelaciones.end(), cancelacion));
+                    PQfreeCancel(cancelacion);
+                }
+                trabajando--;
+            }
+            cambio.notify_all();
+            if (conn) PQfinish(conn);
+        }
+        
+        // Conexión no bloqueante: el connect se abandona al vencer el plazo o si se destruye la
+        // precarga, y statement_timeout acota cada consulta al mismo plazo
+        PGconn* conectar(std::chrono::steady_clock::time_point limite) const {
+            std::string opciones = "-c statement_timeout=" + std::to_string(plazo.count());
+            const char* claves[] = {"dbname", "options", nullptr};
+            const char* valores[] = {conninfo.c_str(), opciones.c_str(), nullptr};
+            PGconn* conn = PQconnectStartParams(claves, valores, 1);
+            PostgresPollingStatusType estado = PGRES_POLLING_WRITING;
+            while (conn && PQstatus(conn) != CONNECTION_BAD && estado != PGRES_POLLING_OK && estado != PGRES_POLLING_FAILED) {
+                if (detener_pedido() || std::chrono::steady_clock::now() >= limite) {
+                    std::cerr << "Precarga: conexion abandonada (plazo vencido o apagado)" << std::endl;
+                    PQfinish(conn);
+                    return nullptr;
+                }
+                int sock = PQsocket(conn);
+                fd_set fds;
+                FD_ZERO(&fds);
+                FD_SET(sock, &fds);
+                timeval timeout;
+                timeout.tv_sec = 0;
+                timeout.tv_usec = 50000;
+                bool leer = estado == PGRES_POLLING_READING;
+                if (select(sock + 1, leer ? &fds : nullptr, leer ? nullptr : &fds, nullptr, &timeout) > 0) {
+                    estado = PQconnectPoll(conn);
+                }
+            }
+            if (PQstatus(conn) != CONNECTION_OK) {
+                std::cerr << "Precarga: no se pudo conectar: " << PQerrorMessage(conn) << std::endl;
+                PQfinish(conn);
+                return nullptr;
+            }
+            return conn;
+        }
+        
+        bool detener_pedido() const {
+            std::lock_guard<std::mutex> lock(mtx);
+            return detenido;
+        }
+        
+        static void cancelar(PGcancel* c) {
+            char error[256];
+            PQcancel(c, error, sizeof(error));
+        }
+    };
+    
+} // namespace ERP
+
+#endif
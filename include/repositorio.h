@@ -0,0 +1,335 @@
+#ifndef REPOSITORIO_H
+#define REPOSITORIO_H
+
+#include "database.h"
+#include <array>
+#include <cstddef>
+#include <cstdlib>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <vector>
+
+namespace ERP {
+    
+    enum OpcionColumna : unsigned {
+        COLUMNA_NORMAL   = 0,
+        COLUMNA_CLAVE    = 1u << 0, // Clave primaria generada por la base (SERIAL)
+        COLUMNA_GENERADA = 1u << 1  // La completa la base (DEFAULT o trigger): no se escribe
+    };
+    
+    // Columna SQL ligada a un miembro de la entidad
+    template <typename T, typename M>
+    struct Columna {
+        const char* nombre;
+        M T::* miembro;
+        unsigned opciones;
+        
+        constexpr bool clave() const { return opciones & COLUMNA_CLAVE; }
+        constexpr bool escribible() const { return !(opciones & (COLUMNA_CLAVE | COLUMNA_GENERADA)); }
+    };
+    
+    template <typename T, typename M>
+    constexpr Columna<T, M> columna(const char* nombre, M T::* miembro, unsigned opciones = COLUMNA_NORMAL) {
+        return {nombre, miembro, opciones};
+    }
+    
+    // Especializar para cada entidad con:
+    //     static constexpr const char* tabla;
+    //     static constexpr auto columnas = std::make_tuple(columna("id", &T::id, COLUMNA_CLAVE), ...);
+    // El orden de 'columnas' es el orden del SELECT y de los bits de máscara de Repositorio::leer.
+    template <typename T>
+    struct Entidad;
+    
+    namespace sql {
+        
+        // Generación de sentencias en tiempo de compilación: la plantilla se recorre una vez
+        // con Contador para conocer el largo y otra con Texto<largo> para escribirla
+        struct Contador {
+            size_t n = 0;
+            constexpr void agregar(const char* t) { while (*t++) n++; }
+            constexpr void numero(size_t v) { do { n++; v /= 10; } while (v); }
+        };
+        
+        template <size_t N>
+        struct Texto {
+            char datos[N + 1] = {};
+            size_t n = 0;
+            
+            constexpr void agregar(const char* t) { while (*t) datos[n++] = *t++; }
+            constexpr void numero(size_t v) {
+                char digitos[20] = {};
+                size_t k = 0;
+                do { digitos[k++] = char('0' + v % 10); v /= 10; } while (v);
+                while (k) datos[n++] = digitos[--k];
+            }
+            constexpr const char* c_str() const { return datos; }
+        };
+        
+        template <typename Plantilla>
+        constexpr auto generar() {
+            constexpr size_t largo = [] { Contador c; Plantilla{}(c); return c.n; }();
+            Texto<largo> texto;
+            Plantilla{}(texto);
+            return texto;
+        }
+        
+        template <typename T>
+        constexpr const char* nombre_clave() {
+            const char* nombre = "";
+            std::apply([&](const auto&... c) { ((c.clave() ? (void)(nombre = c.nombre) : void()), ...); }, Entidad<T>::columnas);
+            return nombre;
+        }
+        
+        // Nombre de la columna en la posición i del descriptor ("" si no existe)
+        template <typename T>
+        constexpr const char* nombre_columna(size_t i) {
+            const char* nombre = "";
+            size_t pos = 0;
+            std::apply([&](const auto&... c) { ((pos++ == i ? (void)(nombre = c.nombre) : void()), ...); }, Entidad<T>::columnas);
+            return nombre;
+        }
+        
+        constexpr bool iguales(const char* a, const char* b) {
+            while (*a && *a == *b) { a++; b++; }
+            return *a == *b;
+        }
+        
+        // SELECT c1, c2, ... FROM tabla
+        template <typename T>
+        struct Select {
+            template <typename S>
+            constexpr void operator()(S& s) const {
+                s.agregar("SELECT ");
+                bool primero = true;
+                std::apply([&](const auto&... c) {
+                    ((s.agregar(primero ? "" : ", "), s.agregar(c.nombre), primero = false), ...);
+                }, Entidad<T>::columnas);
+                s.agregar(" FROM ");
+                s.agregar(Entidad<T>::tabla);
+            }
+        };
+        
+        // SELECT ... FROM tabla WHERE clave = $1
+        template <typename T>
+        struct SelectPorClave {
+            template <typename S>
+            constexpr void operator()(S& s) const {
+                Select<T>{}(s);
+                s.agregar(" WHERE ");
+                s.agregar(nombre_clave<T>());
+                s.agregar(" = $1");
+            }
+        };
+        
+        template <typename T, const char* Resto>
+        struct SelectCon {
+            template <typename S>
+            constexpr void operator()(S& s) const {
+                Select<T>{}(s);
+                s.agregar(Resto);
+            }
+        };
+        
+        // INSERT INTO tabla (escribibles) VALUES ($1, ...)
+        template <typename T>
+        struct Insertar {
+            template <typename S>
+            constexpr void operator()(S& s) const {
+                s.agregar("INSERT INTO ");
+                s.agregar(Entidad<T>::tabla);
+                s.agregar(" (");
+                size_t n = 0;
+                std::apply([&](const auto&... c) {
+                    ((c.escribible() ? (s.agregar(n++ ? ", " : ""), s.agregar(c.nombre)) : void()), ...);
+                }, Entidad<T>::columnas);
+                s.agregar(") VALUES (");
+                for (size_t i = 1; i <= n; i++) {
+                    if (i > 1) s.agregar(", ");
+                    s.agregar("$");
+                    s.numero(i);
+                }
+                s.agregar(")");
+            }
+        };
+        
+        // UPDATE tabla SET escribible = $i, ... WHERE clave = $n+1
+        template <typename T>
+        struct Actualizar {
+            template <typename S>
+            constexpr void operator()(S& s) const {
+                s.agregar("UPDATE ");
+                s.agregar(Entidad<T>::tabla);
+                s.agregar(" SET ");
+                size_t n = 0;
+                std::apply([&](const auto&... c) {
+                    ((c.escribible() ? (s.agregar(n ? ", " : ""), s.agregar(c.nombre), s.agregar(" = $"), s.numero(++n)) : void()), ...);
+                }, Entidad<T>::columnas);
+                s.agregar(" WHERE ");
+                s.agregar(nombre_clave<T>());
+                s.agregar(" = $");
+                s.numero(n + 1);
+            }
+        };
+        
+        // Conversión texto de libpq <-> miembro
+        inline void asignar(int& destino, const char* valor) { destino = std::atoi(valor); }
+        inline void asignar(long long& destino, const char* valor) { destino = std::atoll(valor); }
+        inline void asignar(double& destino, const char* valor) { destino = std::atof(valor); }
+        inline void asignar(bool& destino, const char* valor) { destino = valor[0] == 't'; }
+        inline void asignar(std::string& destino, const char* valor) { destino = valor; }
+        
+        inline void asignar(int& destino, std::string_view valor) { destino = std::atoi(valor.data()); }
+        inline void asignar(long long& destino, std::string_view valor) { destino = std::atoll(valor.data()); }
+        inline void asignar(double& destino, std::string_view valor) { destino = std::atof(valor.data()); }
+        inline void asignar(bool& destino, std::string_view valor) { destino = !valor.empty() && valor[0] == 't'; }
+        inline void asignar(std::string& destino, std::string_view valor) { destino.assign(valor.data(), valor.size()); }
+        
+        inline std::string texto(int valor) { return std::to_string(valor); }
+        inline std::string texto(long long valor) { return std::to_string(valor); }
+        inline std::string texto(double valor) { return std::to_string(valor); }
+        inline std::string texto(bool valor) { return valor ? "true" : "false"; }
+        inline const std::string& texto(const std::string& valor) { return valor; }
+        
+    } // namespace sql
+    
+    // Acceso genérico a una entidad descrita por Entidad<T>. Las sentencias se generan en
+    // compilación y las filas se decodifican por posición según el descriptor, sin armar
+    // strings ni buscar columnas por nombre en cada llamada.
+    template <typename T>
+    class Repositorio {
+    private:
+        Database& db;
+        
+    public:
+        static constexpr size_t NUM_COLUMNAS = std::tuple_size<decltype(Entidad<T>::columnas)>::value;
+        static constexpr unsigned TODAS = (1u << NUM_COLUMNAS) - 1;
+        
+        static constexpr auto SQL_SELECT = sql::generar<sql::Select<T>>();
+        static constexpr auto SQL_POR_CLAVE = sql::generar<sql::SelectPorClave<T>>();
+        static constexpr auto SQL_INSERTAR = sql::generar<sql::Insertar<T>>();
+        static constexpr auto SQL_ACTUALIZAR = sql::generar<sql::Actualizar<T>>();
+        
+        // SELECT <columnas> FROM tabla seguido de Resto (WHERE, ORDER BY...), también en compilación
+        template <const char* Resto>
+        static constexpr auto SELECT_CON = sql::generar<sql::SelectCon<T, Resto>>();
+        
+        explicit Repositorio(Database& database) : db(database) {}
+        
+        // Decodificar la fila 'fila'. Con máscara, el resultado trae solo las columnas cuyo bit
+        // (posición en Entidad<T>::columnas) está encendido, en ese mismo orden.
+        static T leer(PGresult* res, int fila, unsigned mascara = TODAS) {
+            T entidad;
+            int col = 0;
+            unsigned bit = 1;
+            std::apply([&](const auto&... c) {
+                (((mascara & bit) ? sql::asignar(entidad.*(c.miembro), PQgetvalue(res, fila, col++)) : void(), bit <<= 1), ...);
+            }, Entidad<T>::columnas);
+            return entidad;
+        }
+        
+        // Valores de las columnas escribibles, en el orden de SQL_INSERTAR
+        static std::vector<std::string> parametros_escritura(const T& entidad) {
+            std::vector<std::string> params;
+            params.reserve(NUM_COLUMNAS);
+            std::apply([&](const auto&... c) {
+                ((c.escribible() ? params.push_back(sql::texto(entidad.*(c.miembro))) : void()), ...);
+            }, Entidad<T>::columnas);
+            return params;
+        }
+        
+        static std::string valor_clave(const T& entidad) {
+            std::string valor;
+            std::apply([&](const auto&... c) {
+                ((c.clave() ? (void)(valor = sql::texto(entidad.*(c.miembro))) : void()), ...);
+            }, Entidad<T>::columnas);
+            return valor;
+        }
+        
+        // false si no existe o la consulta falla
+        template <typename K>
+        bool obtener(const K& clave, T& entidad, Destino destino = Destino::Replica, const std::string& token = "") {
+            PGresult* res = db.query(SQL_POR_CLAVE.c_str(), {sql::texto(clave)}, destino, token);
+            if (!res) return false;
+            bool encontrado = PQntuples(res) > 0;
+            if (encontrado) entidad = leer(res, 0);
+            PQclear(res);
+            return encontrado;
+        }
+        
+        bool insertar(const T& entidad) {
+            return db.execute(SQL_INSERTAR.c_str(), parametros_escritura(entidad));
+        }
+        
+        bool actualizar(const T& entidad) {
+            std::vector<std::string> params = parametros_escritura(entidad);
+            params.push_back(valor_clave(entidad));
+            return db.execute(SQL_ACTUALIZAR.c_str(), params);
+        }
+    };
+    
+    // Fila de un resultado sin copiarla: los campos son string_view sobre la memoria del
+    // PGresult (largo con PQgetlength), que la vista mantiene vivo. Las posiciones de las
+    // columnas se resuelven con PQfnumber una vez por consulta (columnas()) y se reutilizan
+    // en cada fila; una columna que la consulta no trajo (proyección) queda en -1.
+    template <typename T>
+    class VistaFila {
+    public:
+        using Columnas = std::array<int, Repositorio<T>::NUM_COLUMNAS>;
+        
+        static Columnas columnas(const PGresult* res) {
+            Columnas cols;
+            for (size_t i = 0; i < cols.size(); i++) {
+                cols[i] = PQfnumber(res, sql::nombre_columna<T>(i));
+            }
+            return cols;
+        }
+        
+    private:
+        ResultadoCompartido res;
+        Columnas cols{};
+        int fila = 0;
+        
+    public:
+        VistaFila() = default;
+        VistaFila(ResultadoCompartido resultado, const Columnas& columnas_, int fila_ = 0)
+            : res(std::move(resultado)), cols(columnas_), fila(fila_) {}
+        
+        bool valida() const {
+            return res != nullptr;
+        }
+        
+        // La consulta trajo la columna i (posición en Entidad<T>::columnas) y no es NULL
+        bool tiene(size_t i) const {
+            return cols[i] >= 0 && !PQgetisnull(res.get(), fila, cols[i]);
+        }
+        
+        // Vacío si la columna no vino. Termina en '\0' (libpq lo garantiza en formato texto).
+        std::string_view texto(size_t i) const {
+            if (cols[i] < 0) return {};
+            return std::string_view(PQgetvalue(res.get(), fila, cols[i]),
+                                    (size_t)PQgetlength(res.get(), fila, cols[i]));
+        }
+        
+        int entero(size_t i) const {
+            return cols[i] < 0 ? 0 : std::atoi(PQgetvalue(res.get(), fila, cols[i]));
+        }
+        
+        bool booleano(size_t i) const {
+            return cols[i] >= 0 && PQgetvalue(res.get(), fila, cols[i])[0] == 't';
+        }
+        
+        // Copia a la entidad, para quien necesite conservarla más allá del resultado
+        T materializar() const {
+            T entidad;
+            size_t i = 0;
+            std::apply([&](const auto&... c) {
+                ((cols[i] >= 0 ? sql::asignar(entidad.*(c.miembro), texto(i)) : void(), i++), ...);
+            }, Entidad<T>::columnas);
+            return entidad;
+        }
+    };
+    
+} // namespace ERP
+
+#endif
@@ -0,0 +1,175 @@
+#ifndef TRANSACCION_H
+#define TRANSACCION_H
+
+#include "database.h"
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <future>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
+
+namespace ERP {
+    
+    // Transacción RAII sobre el primario. Las sentencias que el hilo ejecute con Database
+    // mientras vive se unen a ella; si ya había una abierta, esta es un SAVEPOINT dentro de
+    // la externa, así un método del DAO puede abrir la suya sin saber quién lo llama.
+    // Sin confirmar() el destructor revierte.
+    //
+    //     Transaccion tx(db);
+    //     dao.crear(a);
+    //     dao.eliminar(b);
+    //     tx.confirmar();
+    class Transaccion {
+    private:
+        Database& db;
+        std::string savepoint; // Vacío en la transacción externa
+        bool activa_ = false;
+        
+    public:
+        explicit Transaccion(Database& database) : db(database) {
+            activa_ = db.abrir_transaccion(savepoint);
+        }
+        
+        ~Transaccion() {
+            if (activa_) db.cerrar_transaccion(savepoint, false);
+        }
+        
+        Transaccion(const Transaccion&) = delete;
+        Transaccion& operator=(const Transaccion&) = delete;
+        
+        // false si no se pudo abrir (base caída o circuito abierto)
+        bool activa() const {
+            return activa_;
+        }
+        
+        bool confirmar() {
+            if (!activa_) return false;
+            activa_ = false;
+            return db.cerrar_transaccion(savepoint, true);
+        }
+        
+        void revertir() {
+            if (!activa_) return;
+            activa_ = false;
+            db.cerrar_transaccion(savepoint, false);
+        }
+    };
+    
+    // Group commit opcional para ráfagas de escrituras pequeñas de distintas peticiones.
+    // escribir() encola la sentencia y bloquea; un hilo propio junta lo que llega durante
+    // 'ventana' (o hasta 'max_lote' sentencias) y lo ejecuta en una sola transacción. El costo
+    // del flush del WAL se paga una vez por lote en lugar de una vez por escritura.
+    // Sin savepoints (serían dos idas y vueltas más por sentencia): si una sentencia falla se
+    // revierte el lote y cada una se reintenta sola para que su llamador reciba su resultado.
+    // Un lote de una sola escritura se ejecuta directamente, sin BEGIN/COMMIT.
+    // Solo aporta con peticiones concurrentes (httplib, un hilo por conexión); con el
+    // MiniServer de un solo hilo únicamente sumaría la espera de la ventana.
+    class EscritorAgrupado {
+    private:
+        struct Escritura {
+            std::string sql;
+            std::vector<std::string> params;
+            std::promise<bool> resultado;
+        };
+        
+        Database& db;
+        std::chrono::microseconds ventana;
+        size_t max_lote;
+        
+        std::mutex mtx;
+        std::condition_variable hay_trabajo;
+        std::deque<std::unique_ptr<Escritura>> pendientes;
+        bool detenido = false;
+        std::thread hilo;
+        
+    public:
+        EscritorAgrupado(Database& database, std::chrono::microseconds ventana_ = std::chrono::milliseconds(2),
+                         size_t max_lote_ = 256)
+            : db(database), ventana(ventana_), max_lote(max_lote_) {
+            hilo = std::thread(&EscritorAgrupado::bucle, this);
+        }
+        
+        ~EscritorAgrupado() {
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+                detenido = true;
+            }
+            hay_trabajo.notify_one();
+            if (hilo.joinable()) hilo.join();
+        }
+        
+        EscritorAgrupado(const EscritorAgrupado&) = delete;
+        EscritorAgrupado& operator=(const EscritorAgrupado&) = delete;
+        
+        // Equivalente a db.execute(sql, params), pero confirmada junto con las escrituras
+        // concurrentes. Devuelve true solo si la sentencia y el COMMIT del lote tuvieron éxito.
+        bool escribir(const std::string& sql, const std::vector<std::string>& params) {
+            auto escritura = std::make_unique<Escritura>();
+            escritura->sql = sql;
+            escritura->params = params;
+            std::future<bool> resultado = escritura->resultado.get_future();
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+                if (detenido) return false;
+                pendientes.push_back(std::move(escritura));
+            }
+            hay_trabajo.notify_one();
+            return resultado.get();
+        }
+        
+    private:
+        void bucle() {
+            while (true) {
+                std::vector<std::unique_ptr<Escritura>> lote;
+                {
+                    std::unique_lock<std::mutex> lock(mtx);
+                    hay_trabajo.wait(lock, [this] { return detenido || !pendientes.empty(); });
+                    if (pendientes.empty()) return; // Detenido y sin nada pendiente
+                    
+                    // Dar tiempo a que lleguen más escrituras antes de abrir la transacción
+                    auto limite = std::chrono::steady_clock::now() + ventana;
+                    hay_trabajo.wait_until(lock, limite, [this] { return detenido || pendientes.size() >= max_lote; });
+                    
+                    while (!pendientes.empty() && lote.size() < max_lote) {
+                        lote.push_back(std::move(pendientes.front()));
+                        pendientes.pop_front();
+                    }
+                }
+                ejecutar(lote);
+            }
+        }
+        
+        void ejecutar(std::vector<std::unique_ptr<Escritura>>& lote) {
+            std::vector<bool> ok(lote.size(), false);
+            bool reintentar = lote.size() == 1;
+            if (!reintentar) {
+                Transaccion tx(db);
+                if (tx.activa()) {
+                    bool todas = true;
+                    for (size_t i = 0; i < lote.size() && todas; i++) {
+                        todas = db.execute(lote[i]->sql, lote[i]->params);
+                    }
+                    // Si falla el COMMIT no se reintenta: con la conexión caída a mitad del COMMIT
+                    // el lote pudo haberse confirmado igual
+                    if (todas && tx.confirmar()) ok.assign(lote.size(), true);
+                    reintentar = !todas;
+                }
+            }
+            if (reintentar) {
+                for (size_t i = 0; i < lote.size(); i++) {
+                    ok[i] = db.execute(lote[i]->sql, lote[i]->params);
+                }
+            }
+            for (size_t i = 0; i < lote.size(); i++) {
+                lote[i]->resultado.set_value(ok[i]);
+            }
+        }
+    };
+    
+} // namespace ERP
+
+#endif
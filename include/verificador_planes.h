@@ -0,0 +1,245 @@
+#ifndef VERIFICADOR_PLANES_H
+#define VERIFICADOR_PLANES_H
+
+#include "database.h"
+#include "cliente.h"
+#include "transaccion.h"
+#include "json.hpp"
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace ERP {
+    
+    // Resumen del plan de una sentencia del DAO obtenido con EXPLAIN (ANALYZE, BUFFERS, FORMAT JSON)
+    struct PlanSentencia {
+        std::string nombre;
+        std::string forma;          // Árbol de nodos, p. ej. "Limit(Index Scan[idx_clientes_razon_social_id_cubriente])"
+        bool seq_scan = false;      // Algún Seq Scan sobre clientes
+        bool sort = false;          // Algún nodo Sort
+        double tiempo_ms = 0;       // Execution Time
+        long long buffers_hit = 0;
+        long long buffers_leidos = 0;
+    };
+    
+    // Siembra una base local con N clientes dentro de una transacción, mide el plan de cada
+    // sentencia de ClienteDAO::sentencias() y lo compara con una base guardada en JSON.
+    // Todo se revierte con ROLLBACK, incluidas las escrituras que ejecuta EXPLAIN ANALYZE.
+    // Regresión: aparece un Seq Scan o un Sort que la base no tenía, el tiempo supera
+    // tolerancia * tiempo_base + 1 ms o los buffers (hit + leídos) superan
+    // tolerancia * buffers_base + 16. La base está versionada (planes_base.json) y lleva en
+    // "_origen" el servidor y las filas con que se midió: si falta, la verificación falla;
+    // solo --actualizar-base la escribe.
+    class VerificadorPlanes {
+    private:
+        Database& db;
+        int filas;
+        double tolerancia;
+        
+    public:
+        VerificadorPlanes(Database& database, int filas_sembradas = 100000, double tolerancia_tiempo = 2.0)
+            : db(database), filas(filas_sembradas), tolerancia(tolerancia_tiempo) {}
+        
+        // Devuelve el código de salida: 0 sin regresiones, 1 con regresiones o errores
+        int ejecutar(const std::string& archivo_base, bool actualizar_base) {
+            // Sin base no hay contra qué comparar: aceptar los planes actuales sería aprobarlos a ciegas
+            std::ifstream entrada(archivo_base);
+            if (!entrada && !actualizar_base) {
+                std::cerr << "No existe la base de planes " << archivo_base
+                          << ": generarla con --actualizar-base contra una base de referencia" << std::endl;
+                return 1;
+            }
+            
+            std::vector<PlanSentencia> planes;
+            if (!medir(planes)) return 1;
+            
+            for (const auto& p : planes) {
+                std::cout << p.nombre << ": " << p.forma << " | " << p.tiempo_ms << " ms"
+                          << " | hit=" << p.buffers_hit << " read=" << p.buffers_leidos << std::endl;
+            }
+            
+            if (!actualizar_base) {
+                nlohmann::json base;
+                try {
+                    entrada >> base;
+                } catch (const std::exception& e) {
+                    std::cerr << "Base de planes invalida (" << archivo_base << "): " << e.what() << std::endl;
+                    return 1;
+                }
+                int regresiones = comparar(planes, base);
+                std::cout << (regresiones == 0 ? "Sin regresiones de plan" : "Regresiones de plan: " + std::to_string(regresiones)) << std::endl;
+                return regresiones == 0 ? 0 : 1;
+            }
+            
+            nlohmann::json j = a_json(planes);
+            j["_origen"] = {{"servidor", version_servidor()}, {"filas", filas}};
+            std::ofstream salida(archivo_base);
+            salida << j.dump(2) << std::endl;
+            if (!salida) {
+                std::cerr << "No se pudo escribir la base de planes " << archivo_base << std::endl;
+                return 1;
+            }
+            std::cout << "Base de planes guardada en " << archivo_base << std::endl;
+            return 0;
+        }
+        
+        // Sin confirmar(): Transaccion revierte la siembra al salir. El VACUUM previo quita las
+        // filas muertas de siembras anteriores, que inflarían los buffers de cada medición.
+        bool medir(std::vector<PlanSentencia>& planes) {
+            if (!db.execute("VACUUM clientes")) return false;
+            Transaccion tx(db);
+            return tx.activa() && sembrar() && medir_sentencias(planes);
+        }
+        
+        int comparar(const std::vector<PlanSentencia>& planes, const nlohmann::json& base) const {
+            int regresiones = 0;
+            for (const auto& p : planes) {
+                if (!base.contains(p.nombre)) {
+                    std::cout << "[NUEVA] " << p.nombre << " no está en la base (usar --actualizar-base)" << std::endl;
+                    continue;
+                }
+                const auto& b = base[p.nombre];
+                if (p.seq_scan && !b.value("seq_scan", false)) {
+                    std::cout << "[REGRESION] " << p.nombre << ": ahora hace Seq Scan (" << p.forma << ")" << std::endl;
+                    regresiones++;
+                }
+                if (p.sort && !b.value("sort", false)) {
+                    std::cout << "[REGRESION] " << p.nombre << ": ahora ordena en memoria (" << p.forma << ")" << std::endl;
+                    regresiones++;
+                }
+                double limite = b.value("tiempo_ms", 0.0) * tolerancia + 1.0;
+                if (p.tiempo_ms > limite) {
+                    std::cout << "[REGRESION] " << p.nombre << ": " << p.tiempo_ms << " ms supera " << limite << " ms" << std::endl;
+                    regresiones++;
+                }
+                long long buffers = p.buffers_hit + p.buffers_leidos;
+                double limite_buffers = (b.value("buffers_hit", 0LL) + b.value("buffers_leidos", 0LL)) * tolerancia + 16;
+                if (buffers > limite_buffers) {
+                    std::cout << "[REGRESION] " << p.nombre << ": " << buffers << " buffers supera " << (long long)limite_buffers << std::endl;
+                    regresiones++;
+                }
+                if (p.forma != b.value("forma", "")) {
+                    std::cout << "[CAMBIO] " << p.nombre << ": " << b.value("forma", "") << " -> " << p.forma << std::endl;
+                }
+            }
+            return regresiones;
+        }
+        
+        static nlohmann::json a_json(const std::vector<PlanSentencia>& planes) {
+            nlohmann::json j = nlohmann::json::object();
+            for (const auto& p : planes) {
+                j[p.nombre] = {
+                    {"forma", p.forma},
+                    {"seq_scan", p.seq_scan},
+                    {"sort", p.sort},
+                    {"tiempo_ms", p.tiempo_ms},
+                    {"buffers_hit", p.buffers_hit},
+                    {"buffers_leidos", p.buffers_leidos}
+                };
+            }
+            return j;
+        }
+        
+    private:
+        std::string version_servidor() {
+            PGresult* res = db.query("SELECT version()");
+            if (!res) return "";
+            std::string version = PQgetvalue(res, 0, 0);
+            PQclear(res);
+            return version;
+        }
+        
+        // 10% de los clientes sembrados quedan inactivos para que el filtro activo = true pese
+        bool sembrar() {
+            return db.execute(
+                "INSERT INTO clientes (codigo, razon_social, ruc, direccion, telefono, email, activo) "
+                "SELECT 'PLN' || lpad(g::text, 9, '0'), 'Empresa ' || md5(g::text), '8' || lpad(g::text, 10, '0'), "
+                "'Direccion ' || g, '01-' || lpad((g % 10000000)::text, 7, '0'), 'c' || g || '@plan.test', g % 10 <> 0 "
+                "FROM generate_series(1, $1::int) g",
+                {std::to_string(filas)}) &&
+                db.execute("ANALYZE clientes");
+        }
+        
+        bool medir_sentencias(std::vector<PlanSentencia>& planes) {
+            // Cliente de referencia en la mitad del rango sembrado
+            PGresult* res = db.query(
+                "SELECT id, codigo, razon_social, ruc FROM clientes WHERE codigo = 'PLN' || lpad($1, 9, '0')",
+                {std::to_string(filas / 2 + 1)});
+            if (!res || PQntuples(res) == 0) {
+                if (res) PQclear(res);
+                std::cerr << "No se encontró el cliente de referencia sembrado" << std::endl;
+                return false;
+            }
+            std::string id = PQgetvalue(res, 0, 0);
+            std::string codigo = PQgetvalue(res, 0, 1);
+            std::string razon_social = PQgetvalue(res, 0, 2);
+            std::string ruc = PQgetvalue(res, 0, 3);
+            std::string fragmento = razon_social.substr(8, 6); // Parte del md5 sembrado
+            PQclear(res);
+            
+            std::map<std::string, std::vector<std::string>> ejemplos = {
+                {"crear", {"PLNNUEVO", "Empresa Nueva", "99999999999", "Direccion", "01-0000000", "nuevo@plan.test", "true"}},
+                {"listar", {razon_social, id, std::to_string(ClienteDAO::LOTE_LISTADO)}},
+                {"pagina", {"101"}},
+                {"pagina_despues", {razon_social, id, "101"}},
+                {"exportar", {}},
+                {"por_id", {id}},
+                {"buscar", {fragmento, "%" + fragmento + "%", "20"}},
+                {"actualizar", {codigo, razon_social, ruc, "Direccion", "01-0000000", "c@plan.test", id, "1"}},
+                {"version_vigente", {id}},
+                {"sincronizar", {"{PLNSYNC," + codigo + "}", "{Empresa Sync,Empresa Sync 2}", "{99999999998," + ruc + "}",
+                                 "{Direccion,Direccion}", "{01-0000000,01-0000000}", "{s@plan.test,s@plan.test}"}},
+                {"contar", {}},
+                {"eliminar", {id}},
+            };
+            
+            for (const auto& s : ClienteDAO::sentencias()) {
+                auto it = ejemplos.find(s.nombre);
+                if (it == ejemplos.end()) {
+                    std::cerr << "Sentencia sin parámetros de ejemplo: " << s.nombre << std::endl;
+                    return false;
+                }
+                
+                res = db.query(std::string("EXPLAIN (ANALYZE, BUFFERS, FORMAT JSON) ") + s.sql, it->second);
+                if (!res) return false;
+                nlohmann::json explain = nlohmann::json::parse(PQgetvalue(res, 0, 0));
+                PQclear(res);
+                
+                PlanSentencia plan;
+                plan.nombre = s.nombre;
+                const auto& raiz = explain[0];
+                plan.tiempo_ms = raiz.value("Execution Time", 0.0);
+                plan.buffers_hit = raiz["Plan"].value("Shared Hit Blocks", 0LL);
+                plan.buffers_leidos = raiz["Plan"].value("Shared Read Blocks", 0LL);
+                plan.forma = recorrer_nodo(raiz["Plan"], plan);
+                planes.push_back(plan);
+            }
+            return true;
+        }
+        
+        static std::string recorrer_nodo(const nlohmann::json& nodo, PlanSentencia& plan) {
+            std::string tipo = nodo.value("Node Type", "");
+            if (tipo == "Seq Scan" && nodo.value("Relation Name", "") == "clientes") plan.seq_scan = true;
+            if (tipo == "Sort" || tipo == "Incremental Sort") plan.sort = true;
+            
+            std::string forma = tipo;
+            if (nodo.contains("Index Name")) forma += "[" + nodo["Index Name"].get<std::string>() + "]";
+            if (nodo.contains("Plans")) {
+                forma += "(";
+                bool primero = true;
+                for (const auto& hijo : nodo["Plans"]) {
+                    if (!primero) forma += ", ";
+                    forma += recorrer_nodo(hijo, plan);
+                    primero = false;
+                }
+                forma += ")";
+            }
+            return forma;
+        }
+    };
+    
+} // namespace ERP
+
+#endif
@@ -2,6 +2,7 @@
 // Este archivo fuerza la compilación de todas las implementaciones
 
 #include "../include/database.h"
+#include "../include/migraciones.h"
 #include "../include/cliente.h"
 #include "../include/cliente_controller.h"
 #include "../include/miniserver.h"
@@ -26,7 +27,7 @@ void compile_all() {
     // Forzar compilación de algunos métodos
     db.execute("TEST");
     db.query("TEST");
-    db.initialize_tables();
+    ERP::Migrador(db).aplicar();
     
     // Evitar warnings de variables no usadas
     (void)db;
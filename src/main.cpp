@@ -1,9 +1,16 @@
 #include <iostream>
 #include <string>
+#include <vector>
+#include <sstream>
+#include <cstdlib>
 
 #include "database.h"
+#include "migraciones.h"
+#include "verificador_planes.h"
 #include "cliente.h"
 #include "cliente_controller.h"
+#include "almacen_memoria.h"
+#include "almacen_imagen.h"
 
 // Incluir httplib o tu MiniServer
 #ifdef USE_HTTPLIB
@@ -14,21 +21,200 @@
 
 using namespace std::string_literals; // AGREGA ESTA LINEA
 
-int main() {
+int main(int argc, char* argv[]) {
     std::cout << " ERP Sistema - Modulo Clientes con PostgreSQL" << std::endl;
     std::cout << "================================================" << std::endl;
     
     try {
-        // Configuracion de conexion PostgreSQL
+        // Configuracion de conexion PostgreSQL (ERP_DB_PRIMARIO, ERP_DB_REPLICAS separadas por ';')
         std::string conninfo = "host=localhost port=5432 dbname=erp_db user=erp_user password=erp_pass";
+        if (const char* env = std::getenv("ERP_DB_PRIMARIO")) conninfo = env;
         
-        // Crear base de datos y tablas
-        ERP::Database db(conninfo);
-        db.initialize_tables();
+        std::vector<std::string> replicas;
+        if (const char* env = std::getenv("ERP_DB_REPLICAS")) {
+            std::istringstream iss(env);
+            std::string replica;
+            while (std::getline(iss, replica, ';')) {
+                if (!replica.empty()) replicas.push_back(replica);
+            }
+        }
         
-        // Crear DAO y Controller
-        ERP::ClienteDAO cliente_dao(db);
-        ERP::ClienteController cliente_controller(cliente_dao);
+        // Plazo de las peticiones (ERP_PLAZO_MS): statement_timeout por sentencia y, en las
+        // lecturas, PQcancel si el cliente se desconecta antes de que termine la query. Las
+        // altas, cambios y bajas usan el mismo plazo para que la sesión conserve un único
+        // statement_timeout en vez de alternar entre N y 0 con un SET extra cada vez.
+        std::chrono::milliseconds plazo(30000);
+        if (const char* env = std::getenv("ERP_PLAZO_MS")) {
+            char* fin = nullptr;
+            long long ms = std::strtoll(env, &fin, 10);
+            if (fin == env || *fin != '\0' || ms <= 0) {
+                std::cerr << " Error: ERP_PLAZO_MS debe ser un entero positivo de milisegundos (recibido '" << env << "')" << std::endl;
+                return 1;
+            }
+            plazo = std::chrono::milliseconds(ms);
+        }
+        
+        // Almacén de clientes: PostgreSQL por defecto, en memoria con ERP_ALMACEN=memoria
+        // (despliegues sin base y benchmarks que no deben medir la red ni el disco) o, con
+        // ERP_ALMACEN=imagen, de solo lectura desde la imagen mapeada en ERP_IMAGEN
+        const char* env_almacen = std::getenv("ERP_ALMACEN");
+        std::string modo_almacen = env_almacen ? env_almacen : "";
+        bool en_imagen = modo_almacen == "imagen";
+        bool en_memoria = modo_almacen == "memoria" || en_imagen;
+        
+        std::unique_ptr<ERP::Database> db;
+        std::unique_ptr<ERP::ClienteDAO> cliente_dao;
+        std::unique_ptr<ERP::EscritorAgrupado> escritor;
+        std::unique_ptr<ERP::AlmacenMemoria> memoria;
+        std::unique_ptr<ERP::Bitacora> bitacora; // Después de memoria: se destruye antes
+        std::unique_ptr<ERP::AlmacenImagen> solo_lectura;
+        ERP::AlmacenClientes* almacen;
+        
+        if (en_imagen) {
+            // ERP_IMAGEN_VERIFICAR=1 comprueba el CRC de todo el archivo (lo lee entero)
+            const char* ruta = std::getenv("ERP_IMAGEN");
+            const char* verificar = std::getenv("ERP_IMAGEN_VERIFICAR");
+            std::string error;
+            auto imagen = ERP::ImagenClientes::abrir(ruta ? ruta : "clientes.img", error,
+                                                     verificar && std::string(verificar) == "1");
+            if (!imagen) {
+                std::cerr << " Error: imagen de clientes invalida: " << error << std::endl;
+                return 1;
+            }
+            // La imagen es una foto de la tabla a la fecha en que se generó y no sigue sus cambios:
+            // se rechaza la que supere ERP_IMAGEN_MAX_EDAD_S (24 h por defecto; 0 no la limita)
+            long long max_edad = 24 * 3600;
+            if (const char* env = std::getenv("ERP_IMAGEN_MAX_EDAD_S")) {
+                char* fin = nullptr;
+                max_edad = std::strtoll(env, &fin, 10);
+                if (fin == env || *fin != '\0' || max_edad < 0) {
+                    std::cerr << " Error: ERP_IMAGEN_MAX_EDAD_S debe ser un entero de segundos >= 0 (recibido '" << env << "')" << std::endl;
+                    return 1;
+                }
+            }
+            long long edad = (long long)std::difftime(std::time(nullptr), imagen->generada());
+            if (max_edad > 0 && edad > max_edad) {
+                std::cerr << " Error: la imagen de clientes tiene " << edad << " s (maximo " << max_edad
+                          << " s); regenerarla con --generar-imagen" << std::endl;
+                return 1;
+            }
+            std::cout << "Almacen de solo lectura desde la imagen " << (ruta ? ruta : "clientes.img") << ": "
+                      << imagen->cantidad() << " clientes, generada hace " << edad << " s" << std::endl;
+            solo_lectura = std::make_unique<ERP::AlmacenImagen>(imagen);
+            almacen = solo_lectura.get();
+        } else if (en_memoria) {
+            std::cout << "Almacen en memoria (sin PostgreSQL)" << std::endl;
+            memoria = std::make_unique<ERP::AlmacenMemoria>();
+            
+            // Modo durable (ERP_BITACORA = ruta base de la bitácora y la instantánea, p. ej.
+            // /var/lib/erp/clientes): se recupera el estado al iniciar y cada escritura hace fsync
+            if (const char* env = std::getenv("ERP_BITACORA")) {
+                bitacora = std::make_unique<ERP::Bitacora>(env);
+                if (!memoria->usar_bitacora(*bitacora)) {
+                    std::cerr << " Error: no se pudo recuperar la bitacora " << env << std::endl;
+                    return 1;
+                }
+                std::cout << "Bitacora " << env << ": " << memoria->contar_activos() << " clientes activos" << std::endl;
+            }
+            almacen = memoria.get();
+        } else {
+            // Crear base de datos y aplicar migraciones pendientes
+            db = std::make_unique<ERP::Database>(conninfo, replicas);
+            ERP::Migrador migrador(*db);
+            if (!migrador.aplicar()) {
+                std::cerr << " Error: no se pudieron aplicar las migraciones" << std::endl;
+                return 1;
+            }
+            
+            // Modo verificación: --verificar-planes [filas] [--actualizar-base] compara los planes
+            // de todas las sentencias del DAO contra planes_base.json (versionado en la raíz del
+            // repositorio; ejecutar desde ahí) y sale con 1 si hay regresión o falta la base
+            for (int i = 1; i < argc; i++) {
+                if (std::string(argv[i]) != "--verificar-planes") continue;
+                int filas = 100000;
+                bool actualizar_base = false;
+                for (int j = i + 1; j < argc; j++) {
+                    std::string arg = argv[j];
+                    if (arg == "--actualizar-base") actualizar_base = true;
+                    else filas = std::stoi(arg);
+                }
+                ERP::VerificadorPlanes verificador(*db, filas);
+                return verificador.ejecutar("planes_base.json", actualizar_base);
+            }
+            
+            cliente_dao = std::make_unique<ERP::ClienteDAO>(*db);
+            
+            // Group commit opcional (ERP_GRUPO_COMMIT_US = ventana en microsegundos): las altas y
+            // bajas concurrentes se confirman juntas en una sola transacción
+            if (const char* env = std::getenv("ERP_GRUPO_COMMIT_US")) {
+                escritor = std::make_unique<ERP::EscritorAgrupado>(*db, std::chrono::microseconds(std::atoll(env)));
+                cliente_dao->usar_escritor_agrupado(escritor.get());
+            }
+            almacen = cliente_dao.get();
+        }
+        
+        // --generar-imagen <ruta>: volcar el almacén a una imagen mapeable y salir
+        for (int i = 1; i + 1 < argc; i++) {
+            if (std::string(argv[i]) != "--generar-imagen") continue;
+            if (!ERP::AlmacenImagen::generar(*almacen, argv[i + 1])) {
+                std::cerr << " Error: no se pudo generar la imagen " << argv[i + 1] << std::endl;
+                return 1;
+            }
+            std::cout << "Imagen " << argv[i + 1] << " generada" << std::endl;
+            return 0;
+        }
+        
+        // Caché de GET /api/clientes/{id} delante de PostgreSQL (ERP_CACHE_MB = límite en MB,
+        // ERP_CACHE_TTL_S = vigencia de cada entrada, también la del listado completo armado);
+        // los otros almacenes ya están en memoria
+        std::chrono::seconds ttl(300);
+        if (const char* env_ttl = std::getenv("ERP_CACHE_TTL_S")) ttl = std::chrono::seconds(std::atoll(env_ttl));
+        std::unique_ptr<ERP::CacheClientes> cache;
+        if (const char* env = std::getenv("ERP_CACHE_MB")) {
+            if (db && std::atoll(env) > 0) {
+                cache = std::make_unique<ERP::CacheClientes>(*almacen, (size_t)std::atoll(env) << 20, ttl);
+                almacen = cache.get();
+            }
+        }
+        
+        ERP::ClienteController cliente_controller(*almacen, ttl);
+        
+        // Conteo de clientes refrescado en segundo plano
+        ERP::ContadorClientes contador(*almacen);
+        
+        // Precarga de la caché en paralelo por rangos de id (ERP_PRECARGA_CONEXIONES, por
+        // defecto 4; ERP_PRECARGA_PLAZO_S, por defecto 60). /api/ready responde 503 hasta que
+        // termina o vence el plazo; al final deja armada la respuesta del listado completo.
+        std::unique_ptr<ERP::PrecargaClientes> precarga;
+        if (cache) {
+            int conexiones = 4;
+            if (const char* env = std::getenv("ERP_PRECARGA_CONEXIONES")) conexiones = std::atoi(env);
+            std::chrono::seconds plazo_precarga(60);
+            if (const char* env = std::getenv("ERP_PRECARGA_PLAZO_S")) plazo_precarga = std::chrono::seconds(std::atoll(env));
+            if (conexiones > 0) {
+                precarga = std::make_unique<ERP::PrecargaClientes>(
+                    replicas.empty() ? conninfo : replicas.front(), *cache, conexiones, plazo_precarga,
+                    [&cliente_controller] { cliente_controller.listar_todos(); });
+                precarga->iniciar();
+            }
+        }
+        
+        // Escuchar cambios hechos por otros procesos (jobs batch, otras instancias). Sin LISTEN
+        // las cachés siguen, pero los cambios ajenos solo se ven al vencer su TTL.
+        if (db && !db->iniciar_notificaciones()) {
+            std::cerr << " Aviso: sin notificaciones de cambios; las escrituras de otros procesos se veran recien al vencer "
+                      << ttl.count() << " s de ERP_CACHE_TTL_S (listado completo y cache por id)" << std::endl;
+        } else if (db) {
+            // Con réplicas, 'token' (el LSN del primario al recibir el lote) cubre el cambio: la
+            // caché y el listado lo usan para no reconstruirse desde una réplica atrasada
+            db->suscribir([&contador, &cache, &cliente_controller](const std::string& tabla, int id, const std::string& token) {
+                if (tabla != "clientes") return;
+                contador.invalidar();
+                cliente_controller.invalidar_listado(token);
+                if (cache && id == 0) cache->invalidar_todo(token); // Reconexión: pudo perderse cualquier cambio
+                else if (cache) cache->invalidar(id, token);
+            });
+        }
         
         // Configurar servidor HTTP
         #ifdef USE_HTTPLIB
@@ -36,23 +222,81 @@ int main() {
             
             server.Get("/api/clientes", [&](const httplib::Request& req, httplib::Response& res) {
                 std::cout << "GET /api/clientes" << std::endl;
-                res.set_content(cliente_controller.listar_todos(), "application/json");
+                ERP::ParametrosListado p;
+                p.limit = req.get_param_value("limit");
+                p.after = req.get_param_value("after");
+                p.token = req.get_param_value("token");
+                p.fields = req.get_param_value("fields");
+                p.ruc = req.get_param_value("ruc");
+                p.codigo_prefix = req.get_param_value("codigo_prefix");
+                p.activo = req.get_param_value("activo");
+                p.updated_after = req.get_param_value("updated_after");
+                res.set_chunked_content_provider("application/json", [&, p](size_t offset, httplib::DataSink& sink) {
+                    ERP::PlazoPeticion plazo_peticion(plazo, req.is_connection_closed);
+                    if (cliente_controller.listar_stream(p, sink.write)) sink.done();
+                    return false;
+                });
+            });
+            
+            server.Get("/api/clientes/export", [&](const httplib::Request& req, httplib::Response& res) {
+                std::cout << "GET /api/clientes/export" << std::endl;
+                res.set_chunked_content_provider("text/csv", [&](size_t offset, httplib::DataSink& sink) {
+                    if (almacen->exportar_csv(sink.write)) sink.done();
+                    return false;
+                });
+            });
+            
+            server.Get("/api/clientes/search", [&](const httplib::Request& req, httplib::Response& res) {
+                std::cout << "GET /api/clientes/search" << std::endl;
+                ERP::PlazoPeticion plazo_peticion(plazo, req.is_connection_closed);
+                res.set_content(cliente_controller.buscar(req.get_param_value("q"), req.get_param_value("limit")), "application/json");
+            });
+            
+            server.Get("/api/clientes/count", [&](const httplib::Request& req, httplib::Response& res) {
+                res.set_content(cliente_controller.contar(contador), "application/json");
+            });
+            
+            server.Get("/api/ready", [&](const httplib::Request& req, httplib::Response& res) {
+                res.set_content(cliente_controller.preparado(precarga.get()), "application/json");
+                if (precarga && !precarga->lista()) res.status = 503;
+            });
+            
+            server.Get("/api/clientes/cache", [&](const httplib::Request& req, httplib::Response& res) {
+                if (cache) res.set_content(cliente_controller.estadisticas_cache(*cache), "application/json");
+                else res.set_content("{\"exito\":false,\"mensaje\":\"Cache desactivada\",\"codigo_error\":404}", "application/json");
             });
             
             server.Get("/api/clientes/(\\d+)", [&](const httplib::Request& req, httplib::Response& res) {
                 int id = std::stoi(req.matches[1]);
                 std::cout << "GET /api/clientes/" << id << std::endl;
-                res.set_content(cliente_controller.obtener_por_id(id), "application/json");
+                ERP::PlazoPeticion plazo_peticion(plazo, req.is_connection_closed);
+                res.set_content(cliente_controller.obtener_por_id(id, req.get_param_value("token")), "application/json");
             });
             
             server.Post("/api/clientes", [&](const httplib::Request& req, httplib::Response& res) {
                 std::cout << "POST /api/clientes" << std::endl;
+                ERP::PlazoPeticion plazo_peticion(plazo);
                 res.set_content(cliente_controller.crear(req.body), "application/json");
             });
             
+            server.Put("/api/clientes/(\\d+)", [&](const httplib::Request& req, httplib::Response& res) {
+                int id = std::stoi(req.matches[1]);
+                std::cout << "PUT /api/clientes/" << id << std::endl;
+                ERP::PlazoPeticion plazo_peticion(plazo);
+                int estado = 200;
+                res.set_content(cliente_controller.actualizar(id, req.body, estado), "application/json");
+                res.status = estado;
+            });
+            
+            server.Post("/api/clientes/sync", [&](const httplib::Request& req, httplib::Response& res) {
+                std::cout << "POST /api/clientes/sync" << std::endl;
+                res.set_content(cliente_controller.sincronizar(req.body, req.get_param_value("lote")), "application/json");
+            });
+            
             server.Delete("/api/clientes/(\\d+)", [&](const httplib::Request& req, httplib::Response& res) {
                 int id = std::stoi(req.matches[1]);
                 std::cout << "DELETE /api/clientes/" << id << std::endl;
+                ERP::PlazoPeticion plazo_peticion(plazo);
                 res.set_content(cliente_controller.eliminar(id), "application/json");
             });
             
@@ -62,34 +306,114 @@ int main() {
         #else
             MiniServer server(8080);
             
-            server.get("/api/clientes", [&](const std::string& method, const std::string& body) -> std::string {
+            server.get_stream("/api/clientes", "application/json", [&](const std::string& path, const MiniServer::ChunkWriter& write) {
                 std::cout << "GET /api/clientes" << std::endl;
-                return cliente_controller.listar_todos();
+                ERP::PlazoPeticion plazo_peticion(plazo, [&] { return server.client_disconnected(); });
+                ERP::ParametrosListado p;
+                p.limit = MiniServer::query_param(path, "limit");
+                p.after = MiniServer::query_param(path, "after");
+                p.token = MiniServer::query_param(path, "token");
+                p.fields = MiniServer::query_param(path, "fields");
+                p.ruc = MiniServer::query_param(path, "ruc");
+                p.codigo_prefix = MiniServer::query_param(path, "codigo_prefix");
+                p.activo = MiniServer::query_param(path, "activo");
+                p.updated_after = MiniServer::query_param(path, "updated_after");
+                return cliente_controller.listar_stream(p, write);
+            });
+            
+            server.get_stream("/api/clientes/export", "text/csv", [&](const std::string& path, const MiniServer::ChunkWriter& write) {
+                std::cout << "GET /api/clientes/export" << std::endl;
+                return almacen->exportar_csv(write);
+            });
+            
+            server.get("/api/clientes/search", [&](const std::string& path, const std::string& body) -> std::string {
+                std::cout << "GET /api/clientes/search" << std::endl;
+                ERP::PlazoPeticion plazo_peticion(plazo, [&] { return server.client_disconnected(); });
+                return cliente_controller.buscar(MiniServer::query_param(path, "q"), MiniServer::query_param(path, "limit"));
+            });
+            
+            server.get("/api/clientes/count", [&](const std::string& path, const std::string& body) -> std::string {
+                return cliente_controller.contar(contador);
+            });
+            
+            server.get("/api/ready", [&](const std::string& path, const std::string& body) -> std::string {
+                if (precarga && !precarga->lista()) server.set_status(503);
+                return cliente_controller.preparado(precarga.get());
+            });
+            
+            server.get("/api/clientes/cache", [&](const std::string& path, const std::string& body) -> std::string {
+                if (!cache) return "{\"exito\":false,\"mensaje\":\"Cache desactivada\",\"codigo_error\":404}";
+                return cliente_controller.estadisticas_cache(*cache);
             });
             
-            server.get("/api/clientes/", [&](const std::string& method, const std::string& body) -> std::string {
+            // Conexiones no bloqueantes atendidas por el mismo select() del servidor
+            std::unique_ptr<ERP::AsyncDatabase> async_db;
+            if (!en_memoria) {
+                async_db = std::make_unique<ERP::AsyncDatabase>(replicas.empty() ? conninfo : replicas.front(), 4);
+                server.add_poll_source({
+                    [&](std::vector<int>& read, std::vector<int>& write) { async_db->sockets(read, write); },
+                    [&]() { async_db->procesar(); }
+                });
+            }
+            
+            server.get_async("/api/clientes/", [&](const std::string& path, const std::string& body, MiniServer::Responder respond) {
                 try {
-                    size_t last_slash = method.find_last_of('/');
+                    std::string ruta = path.substr(0, path.find('?'));
+                    size_t last_slash = ruta.find_last_of('/');
                     if (last_slash != std::string::npos) {
-                        int id = std::stoi(method.substr(last_slash + 1));
+                        int id = std::stoi(ruta.substr(last_slash + 1));
                         std::cout << "GET /api/clientes/" << id << std::endl;
-                        return cliente_controller.obtener_por_id(id);
+                        // Con token de consistencia se usa la ruta síncrona, que elige una réplica al día
+                        // (y también sin base: el almacén en memoria responde en el acto)
+                        std::string token = MiniServer::query_param(path, "token");
+                        if (!token.empty() || !async_db) {
+                            ERP::PlazoPeticion plazo_peticion(plazo, [&] { return server.client_disconnected(); });
+                            respond(cliente_controller.obtener_por_id(id, token));
+                            return;
+                        }
+                        cliente_controller.obtener_por_id_async(*async_db, id, respond);
+                        return;
                     }
                 } catch (...) {}
-                return "{\"error\":\"ID invalido\"}"s; // Usa "s" literal
+                respond("{\"error\":\"ID invalido\"}"s); // Usa "s" literal
             });
             
-            server.post("/api/clientes", [&](const std::string& method, const std::string& body) -> std::string {
+            server.post("/api/clientes", [&](const std::string& path, const std::string& body) -> std::string {
                 std::cout << "POST /api/clientes" << std::endl;
+                ERP::PlazoPeticion plazo_peticion(plazo);
                 return cliente_controller.crear(body);
             });
             
-            server.del("/api/clientes/", [&](const std::string& method, const std::string& body) -> std::string {
+            server.post("/api/clientes/sync", [&](const std::string& path, const std::string& body) -> std::string {
+                std::cout << "POST /api/clientes/sync" << std::endl;
+                return cliente_controller.sincronizar(body, MiniServer::query_param(path, "lote"));
+            });
+            
+            server.put("/api/clientes/", [&](const std::string& path, const std::string& body) -> std::string {
+                try {
+                    std::string ruta = path.substr(0, path.find('?'));
+                    size_t last_slash = ruta.find_last_of('/');
+                    if (last_slash != std::string::npos) {
+                        int id = std::stoi(ruta.substr(last_slash + 1));
+                        std::cout << "PUT /api/clientes/" << id << std::endl;
+                        ERP::PlazoPeticion plazo_peticion(plazo);
+                        int estado = 200;
+                        std::string respuesta = cliente_controller.actualizar(id, body, estado);
+                        server.set_status(estado);
+                        return respuesta;
+                    }
+                } catch (...) {}
+                return "{\"error\":\"ID invalido\"}"s; // Usa "s" literal
+            });
+            
+            server.del("/api/clientes/", [&](const std::string& path, const std::string& body) -> std::string {
                 try {
-                    size_t last_slash = method.find_last_of('/');
+                    std::string ruta = path.substr(0, path.find('?'));
+                    size_t last_slash = ruta.find_last_of('/');
                     if (last_slash != std::string::npos) {
-                        int id = std::stoi(method.substr(last_slash + 1));
+                        int id = std::stoi(ruta.substr(last_slash + 1));
                         std::cout << "DELETE /api/clientes/" << id << std::endl;
+                        ERP::PlazoPeticion plazo_peticion(plazo);
                         return cliente_controller.eliminar(id);
                     }
                 } catch (...) {}
@@ -100,6 +424,9 @@ int main() {
             server.start();
         #endif
         
+        // Los suscriptores usan objetos locales que se destruyen antes que db
+        if (db) db->detener_notificaciones();
+        
     } catch (const std::exception& e) {
         std::cerr << " Error: " << e.what() << std::endl;
         return 1;